@@ -0,0 +1,86 @@
+#include "arrange.hpp"
+#include "card.hpp"
+#include "card_pool.hpp"
+#include "common.hpp"
+
+// Only sets where the cards tween to. Positions and sizes are read from card_hot, so nothing but the
+// selected cards' targets is touched and no Card is copied.
+void arrange_selected_cards(CardPool& cards, ArrangeMode mode, Vector2 origin) {
+    static std::vector<int> selected;
+    selected.clear();
+    for (int i = 0; i < (int) card_hot.flags.size(); i++) {
+        if ((card_hot.flags[i] & (CARD_SELECTED | CARD_UNUSED)) == CARD_SELECTED) selected.push_back(i);
+    }
+    if (selected.empty()) return;
+
+    switch (mode) {
+    case ARRANGE_ROW: {
+        std::sort(selected.begin(), selected.end(), [](int index1, int index2) {
+            return card_hot.x[index1] < card_hot.x[index2];
+        });
+        float move = 0;
+        for (auto index: selected) {
+            set_card_target(pool_card(cards, index), (Vector2) {origin.x + move, origin.y});
+            move += card_hot.width[index];
+        }
+        break;
+    }
+    case ARRANGE_COLUMN: {
+        std::sort(selected.begin(), selected.end(), [](int index1, int index2) {
+            return card_hot.y[index1] < card_hot.y[index2];
+        });
+        float move = 0;
+        for (auto index: selected) {
+            set_card_target(pool_card(cards, index), (Vector2) {origin.x, origin.y + move});
+            move += card_hot.height[index];
+        }
+        break;
+    }
+    case ARRANGE_STACK: {
+        for (auto index: selected) {
+            set_card_target(pool_card(cards, index), origin);
+        }
+        break;
+    }
+    case ARRANGE_GRID: {
+        std::sort(selected.begin(), selected.end(), [](int index1, int index2) {
+            if (card_hot.y[index1] != card_hot.y[index2]) return card_hot.y[index1] < card_hot.y[index2];
+            return card_hot.x[index1] < card_hot.x[index2];
+        });
+        // Every cell is as big as the biggest card, so nothing overlaps.
+        float cell_width = 0;
+        float cell_height = 0;
+        for (auto index: selected) {
+            cell_width = fmaxf(cell_width, card_hot.width[index]);
+            cell_height = fmaxf(cell_height, card_hot.height[index]);
+        }
+        int columns = ceilf(sqrtf(selected.size()));
+        for (int i = 0; i < (int) selected.size(); i++) {
+            Vector2 target = {origin.x + (i % columns) * cell_width, origin.y + (i / columns) * cell_height};
+            set_card_target(pool_card(cards, selected[i]), target);
+        }
+        break;
+    }
+    case ARRANGE_TIMELINE: {
+        std::sort(selected.begin(), selected.end(), [](int index1, int index2) {
+            if (card_hot.x[index1] != card_hot.x[index2]) return card_hot.x[index1] < card_hot.x[index2];
+            return card_hot.y[index1] < card_hot.y[index2];
+        });
+        float column_x = origin.x;
+        float column_width = 0;
+        float move = 0;
+        for (auto index: selected) {
+            auto &card = pool_card(cards, index);
+            if (card.type == PERIOD && column_width > 0) {
+                column_x += column_width;
+                column_width = 0;
+                move = 0;
+            }
+            set_card_target(card, (Vector2) {column_x, origin.y + move});
+            move += card_hot.height[index];
+            column_width = fmaxf(column_width, card_hot.width[index]);
+        }
+        break;
+    }
+    }
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include "common.hpp"
+#include "card.hpp"
+
+// Ways the arrange keys lay out the selected cards, starting at the cursor.
+enum ArrangeMode {
+    ARRANGE_ROW,      // Side by side, in their current left to right order
+    ARRANGE_COLUMN,   // One under the other, in their current top to bottom order
+    ARRANGE_STACK,    // All on the same spot
+    ARRANGE_GRID,     // Packed into a roughly square grid, in reading order
+    ARRANGE_TIMELINE, // A column per period, with the events and scenes that follow it stacked underneath
+};
+
+void arrange_selected_cards(CardPool& cards, ArrangeMode mode, Vector2 origin);
@@ -0,0 +1,177 @@
+#include "autosave.hpp"
+#include <chrono>
+#include <fstream>
+
+static double milliseconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static size_t file_size(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    return file ? (size_t) file.tellg() : 0;
+}
+
+static bool append_to_file(const std::string& filename, const std::string& text) {
+    std::ofstream file(filename, std::ios::binary | std::ios::app);
+    file.write(text.data(), text.size());
+    file.close();
+    return (bool) file;
+}
+
+static void autosave_main(Autosave *autosave) {
+    std::unique_lock<std::mutex> lock(autosave->mutex);
+    while (true) {
+        autosave->job_ready.wait(lock, [&]() { return autosave->quitting || !autosave->jobs.empty(); });
+        if (autosave->jobs.empty()) return;
+        auto job = std::move(autosave->jobs.front());
+        autosave->jobs.pop_front();
+        lock.unlock();
+
+        bool journaled = job.journal.empty() || append_to_file(autosave->journal_filename, job.journal);
+        bool compacted = false;
+        double compact_ms = 0;
+        size_t save_size = 0;
+        if (job.compact) {
+            auto start = std::chrono::steady_clock::now();
+            compacted = write_save_snapshot(job.snapshot, autosave->filename.c_str(), autosave->format);
+            // Everything journaled so far is in the save now. Anything after is in later jobs.
+            if (compacted) std::remove(autosave->journal_filename.c_str());
+            compact_ms = milliseconds_since(start);
+            save_size = file_size(autosave->filename);
+            // Let go of the text now rather than with the next job, so deleted cards and old mappings don't linger.
+            job.snapshot.cards.clear();
+            job.snapshot.under.clear();
+        }
+
+        lock.lock();
+        autosave->last_write_failed = !journaled || (job.compact && !compacted);
+        if (autosave->last_write_failed) autosave->needs_compaction = true;
+        if (job.compact) {
+            autosave->compacting = false;
+            if (compacted) {
+                autosave->last_compact_ms = compact_ms;
+                autosave->save_size = save_size;
+                autosave->compactions += 1;
+            }
+        }
+    }
+}
+
+// `cards` should be the board just loaded from `filename`. A journal left over from last time is compacted
+// at the first chance.
+void start_autosave(Autosave& autosave, const CardPool& cards, const char *filename, SaveFormat format, double interval) {
+    autosave.jobs.clear();
+    autosave.compacting = false;
+    autosave.quitting = false;
+    reset_journal(autosave.journal, cards);
+    autosave.text_cache = {};
+    autosave.filename = filename;
+    autosave.journal_filename = journal_filename(filename);
+    autosave.format = format;
+    autosave.interval = interval;
+    autosave.last_journal_time = GetTime();
+    autosave.journal_size = file_size(autosave.journal_filename);
+    autosave.needs_compaction = autosave.journal_size > 0;
+    autosave.unloaded.clear();
+    autosave.board_changed = false;
+    autosave.operations_journaled = 0;
+    autosave.last_journal_ms = 0;
+    autosave.last_snapshot_ms = 0;
+    autosave.last_compact_ms = 0;
+    autosave.save_size = file_size(autosave.filename);
+    autosave.compactions = 0;
+    autosave.last_write_failed = false;
+    autosave.thread = std::thread(autosave_main, &autosave);
+}
+
+// Hands the edits since last time to the thread, once the interval is up and the board changed. Then starts a
+// compaction if the journal has grown big enough and there isn't one going already.
+void update_autosave(Autosave& autosave, CardPool& cards, bool board_changed) {
+    if (!autosave.unloaded.empty()) return;
+    if (board_changed) autosave.board_changed = true;
+    if (GetTime() - autosave.last_journal_time < autosave.interval) return;
+    bool needs_compaction;
+    bool compacting;
+    size_t save_size;
+    {
+        std::lock_guard<std::mutex> lock(autosave.mutex);
+        needs_compaction = autosave.needs_compaction;
+        compacting = autosave.compacting;
+        save_size = autosave.save_size;
+    }
+    if (!autosave.board_changed && !(needs_compaction && !compacting)) return;
+    autosave.last_journal_time = GetTime();
+    autosave.board_changed = false;
+
+    auto start = std::chrono::steady_clock::now();
+    std::string lines;
+    autosave.operations_journaled += journal_changes(autosave.journal, cards, lines);
+    autosave.journal_size += lines.size();
+    autosave.last_journal_ms = milliseconds_since(start);
+
+    bool compact = !compacting && (needs_compaction ||
+        (autosave.journal_size >= JOURNAL_COMPACT_MIN_BYTES && autosave.journal_size >= save_size / 2));
+    AutosaveJob job = {};
+    if (compact) {
+        start = std::chrono::steady_clock::now();
+        job.compact = true;
+        take_save_snapshot(cards, job.snapshot, &autosave.text_cache);
+        autosave.last_snapshot_ms = milliseconds_since(start);
+        autosave.journal_size = 0;
+    }
+    {
+        std::lock_guard<std::mutex> lock(autosave.mutex);
+        if (!lines.empty()) {
+            if (autosave.jobs.empty() || autosave.jobs.back().compact) autosave.jobs.push_back(AutosaveJob());
+            autosave.jobs.back().journal += lines;
+        }
+        if (compact) {
+            autosave.jobs.push_back(std::move(job));
+            autosave.compacting = true;
+            autosave.needs_compaction = false;
+        }
+    }
+    autosave.job_ready.notify_one();
+}
+
+// For when the board was replaced wholesale, by a new game or opening another file. Rather than journal the
+// whole board as created, it's written out as the save at the next update.
+void rebase_autosave(Autosave& autosave, const CardPool& cards) {
+    reset_journal(autosave.journal, cards);
+    std::lock_guard<std::mutex> lock(autosave.mutex);
+    autosave.needs_compaction = true;
+}
+
+// For when a save failed to load, so the board is missing whatever couldn't be read. Compacting would write
+// that board over the save and drop the journal, so nothing more is written this session: the save and its
+// journal are left for the player to recover, and the status line says why.
+void suspend_autosave(Autosave& autosave, const char *unloaded) {
+    autosave.unloaded = unloaded;
+}
+
+// Journals the last edits and waits for everything handed over to be written, then stops the thread. False if
+// any of it failed, in which case the board should be saved some other way. Suspended, nothing is journaled,
+// and there's nothing to save some other way either.
+bool stop_autosave(Autosave& autosave, CardPool& cards) {
+    std::string lines;
+    if (autosave.unloaded.empty()) journal_changes(autosave.journal, cards, lines);
+    {
+        std::lock_guard<std::mutex> lock(autosave.mutex);
+        if (!lines.empty()) autosave.jobs.push_back({lines, false, SaveSnapshot()});
+        autosave.quitting = true;
+    }
+    autosave.job_ready.notify_one();
+    if (autosave.thread.joinable()) autosave.thread.join();
+    // The cache may be keeping a lazy save mapped.
+    autosave.text_cache = {};
+    return !autosave.unloaded.empty() || !autosave.needs_compaction;
+}
+
+const char *autosave_status(Autosave& autosave) {
+    std::lock_guard<std::mutex> lock(autosave.mutex);
+    if (!autosave.unloaded.empty()) return TextFormat("Autosave off: %s didn't load, so nothing is being saved", autosave.unloaded.c_str());
+    if (autosave.last_write_failed) return TextFormat("Autosave failed (%s)", autosave.filename.c_str());
+    return TextFormat("Journal: %d edits (%.1fms), %dKB; %d compactions (%.1fms snapshot, %.0fms write)",
+        autosave.operations_journaled, autosave.last_journal_ms, (int) (autosave.journal_size / 1024),
+        autosave.compactions, autosave.last_snapshot_ms, autosave.last_compact_ms);
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include "common.hpp"
+#include "serialization.hpp"
+#include "journal.hpp"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#define AUTOSAVE_INTERVAL 5.0 // Seconds between journal writes
+// The journal is folded into a fresh save once it's this big and half the size of the save.
+#define JOURNAL_COMPACT_MIN_BYTES (256 * 1024)
+
+// One thing for the autosave thread to do. Jobs are done in the order they were handed over.
+struct AutosaveJob {
+    std::string journal; // Lines to append to the journal
+    bool compact; // Then write `snapshot` as the save and empty the journal
+    SaveSnapshot snapshot;
+};
+
+// Saves the board as it changes. Every so often the edits since last time are appended to the save's journal,
+// which costs in proportion to the edits, not the board. Once the journal has grown big enough it's compacted:
+// the main thread takes a snapshot, which mostly shares its text with the last one, and the save is rewritten
+// from it. Files are only touched by a thread of its own, so saving never holds up a frame for longer than
+// finding the edits or taking a snapshot takes.
+struct Autosave {
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable job_ready;
+    std::deque<AutosaveJob> jobs; // Guarded by `mutex`
+    bool compacting; // A compaction is queued or being written, guarded by `mutex`
+    bool needs_compaction; // A write failed, so the journal may be missing edits. Guarded by `mutex`
+    bool quitting;
+    Journal journal;
+    SnapshotTextCache text_cache;
+    std::string filename;
+    std::string journal_filename;
+    SaveFormat format;
+    double interval;
+    bool board_changed; // Since the last journal write
+    double last_journal_time;
+    size_t journal_size; // Bytes journaled since the last compaction was queued
+    std::string unloaded; // A save that failed to load. While it's set nothing is written, so a board that's
+                          // missing cards can't replace the save or its journal
+
+    // For the status line. The ones the thread writes are guarded by `mutex`.
+    int operations_journaled;
+    double last_journal_ms;
+    double last_snapshot_ms;
+    double last_compact_ms;
+    size_t save_size;
+    int compactions;
+    bool last_write_failed;
+};
+
+void start_autosave(Autosave& autosave, const CardPool& cards, const char *filename = "save.json", SaveFormat format = SAVE_JSON, double interval = AUTOSAVE_INTERVAL);
+void update_autosave(Autosave& autosave, CardPool& cards, bool board_changed);
+void rebase_autosave(Autosave& autosave, const CardPool& cards);
+void suspend_autosave(Autosave& autosave, const char *unloaded);
+bool stop_autosave(Autosave& autosave, CardPool& cards);
+const char *autosave_status(Autosave& autosave);
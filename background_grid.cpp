@@ -0,0 +1,76 @@
+#include "background_grid.hpp"
+#include "common.hpp"
+
+// Two grid cells of white with a blue dot where the corners meet. Repeats every GRIDSIZE texels.
+static Texture generate_grid() {
+    auto data = std::vector<char>();
+    int gridsize = GRIDSIZE;
+    for (int y = 0; y < gridsize * 2; y++) {
+        for (int x = 0; x < gridsize * 2; x++) {
+            auto current_color = WHITE;
+            if ((x % gridsize == 0 || x % gridsize == gridsize - 1) && (y % gridsize == 0 || y % gridsize == gridsize - 1)) current_color = BLUE;
+            data.push_back(current_color.r);
+            data.push_back(current_color.g);
+            data.push_back(current_color.b);
+            data.push_back(current_color.a);
+        }
+    }
+    Image image = {data.data(), gridsize * 2, gridsize * 2, 1, UNCOMPRESSED_R8G8B8A8};
+    auto texture = LoadTextureFromImage(image);
+    SetTextureWrap(texture, WRAP_REPEAT);
+    return texture;
+}
+
+BackgroundGrid init_background_grid() {
+    BackgroundGrid grid;
+    grid.texture = generate_grid();
+    grid.shader = LoadShader(0, "assets/grid.fs");
+    grid.view_origin_loc = GetShaderLocation(grid.shader, "view_origin");
+    grid.view_size_loc = GetShaderLocation(grid.shader, "view_size");
+    grid.spacing_loc = GetShaderLocation(grid.shader, "spacing");
+    // raylib hands back its default shader if grid.fs is missing or doesn't compile, which has none of the uniforms.
+    grid.has_shader = grid.view_origin_loc != -1 && grid.view_size_loc != -1 && grid.spacing_loc != -1;
+    return grid;
+}
+
+void unload_background_grid(BackgroundGrid& grid) {
+    UnloadTexture(grid.texture);
+    if (grid.has_shader) UnloadShader(grid.shader);
+}
+
+// World units between grid dots at this zoom. Always GRIDSIZE times a power of two, so dots stay on the card grid.
+float background_grid_spacing(Camera2D camera) {
+    float spacing = GRIDSIZE;
+    while (spacing * camera.zoom < BACKGROUND_GRID_MIN_CELL_PIXELS) spacing *= 2;
+    return spacing;
+}
+
+// Only the part of the grid inside the camera view is drawn. Must be called inside BeginMode2D(camera).
+void draw_background_grid(const BackgroundGrid& grid, Camera2D camera) {
+    auto view = get_camera_view_rect(camera);
+    float spacing = background_grid_spacing(camera);
+
+    if (grid.has_shader) {
+        Vector2 view_origin = {view.x, view.y};
+        Vector2 view_size = {view.width, view.height};
+        SetShaderValue(grid.shader, grid.view_origin_loc, &view_origin, UNIFORM_VEC2);
+        SetShaderValue(grid.shader, grid.view_size_loc, &view_size, UNIFORM_VEC2);
+        SetShaderValue(grid.shader, grid.spacing_loc, &spacing, UNIFORM_FLOAT);
+        BeginShaderMode(grid.shader);
+        DrawTexturePro(grid.texture, (Rectangle) {0, 0, (float) grid.texture.width, (float) grid.texture.height}, view, (Vector2) {0, 0}, 0, WHITE);
+        EndShaderMode();
+    } else {
+        // One texel per world unit at full detail. Coarser levels stretch each texel over more of the world.
+        float texel_size = spacing / GRIDSIZE;
+        Rectangle source = {view.x / texel_size, view.y / texel_size, view.width / texel_size, view.height / texel_size};
+        DrawTexturePro(grid.texture, source, view, (Vector2) {0, 0}, 0, WHITE);
+    }
+
+    // Draw Description Lines
+    if (view.x <= 0 && 0 <= view.x + view.width) {
+        DrawLineEx((Vector2) {0, view.y}, (Vector2) {0, view.y + view.height}, 3.0, SKYBLUE);
+    }
+    if (view.y <= 0 && 0 <= view.y + view.height) {
+        DrawLineEx((Vector2) {view.x, 0}, (Vector2) {view.x + view.width, 0}, 3.0, SKYBLUE);
+    }
+}
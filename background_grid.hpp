@@ -0,0 +1,22 @@
+#pragma once
+#include "common.hpp"
+
+// The grid spacing is doubled until a cell is at least this many pixels on screen, so zooming out doesn't
+// turn the grid into noise.
+#define BACKGROUND_GRID_MIN_CELL_PIXELS 8.0
+
+// The dotted grid behind the board. Drawn with assets/grid.fs when it loads, otherwise by repeating a small
+// texture over the visible area.
+struct BackgroundGrid {
+    Texture2D texture;
+    Shader shader;
+    bool has_shader;
+    int view_origin_loc;
+    int view_size_loc;
+    int spacing_loc;
+};
+
+BackgroundGrid init_background_grid();
+void unload_background_grid(BackgroundGrid& grid);
+float background_grid_spacing(Camera2D camera);
+void draw_background_grid(const BackgroundGrid& grid, Camera2D camera);
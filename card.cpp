@@ -1,5 +1,9 @@
 #include "card.hpp"
+#include "card_pool.hpp"
 #include "common.hpp"
+#include "sprite_batch.hpp"
+#include "text_buffer.hpp"
+#include <cassert>
 #include <random>
 
 std::string get_uuid() {
@@ -25,12 +29,16 @@ Card init_card(std::string name, Rectangle body_rect, CardType type) {
     float header_height = 20.0;
     Card card;
     card.id = get_uuid();
+    card.slot = -1;
+    card.lazy = {-1, 0};
     card.name = name;
     card.content = "";
+    touch_card_content(card);
     card.last_name = name;
     card.last_content = "";
     card.cards_under = std::vector<Card>();
-    card.parent = NULL;
+    card.parent = NO_CARD;
+    card.handle = NO_CARD;
     card.textures = &spritesheet;
     card.fontsize = REGULAR;
     card.font = &application_font_regular;
@@ -47,6 +55,7 @@ Card init_card(std::string name, Rectangle body_rect, CardType type) {
     card.body_rect = body_rect;
     card.lock_target = {body_rect.x, body_rect.y};
     card.saved_dimensions = {0};
+    card.layout = init_text_layout();
     card.header_rec   = {card.body_rect.x, card.body_rect.y - header_height, card.body_rect.width - 30, header_height};
     card.close_button = init_button();
     card.edit_button  = init_button();
@@ -60,16 +69,15 @@ Card init_card(std::string name, Rectangle body_rect, CardType type) {
     card.remove_from_drawer_button = init_button();
 
     card.depth = 0;
-    card.drawn = false;
     return card;
 }
 
-Card* greatest_depth_and_furthest_along(std::vector<Card>& cards) {
-    if (cards.size() == 0) {
+Card* greatest_depth_and_furthest_along(CardPool& cards) {
+    if (cards.active_cards == 0) {
         return NULL;
     }
     auto current_depth = 0;
-    Card *current_card = &cards[0];
+    Card *current_card = &*begin(cards);
     for (auto &card: cards) {
         if (card.depth > current_depth) {
             current_card = &card;
@@ -79,73 +87,389 @@ Card* greatest_depth_and_furthest_along(std::vector<Card>& cards) {
     return current_card;
 }
 
-int smallest_depth(const std::vector<Card>& cards) {
-    int depth = 9999;
-    for (auto &card: cards) {
-        if (card.depth < depth) depth = card.depth;
+static bool drawn_before(int index1, int index2) {
+    if (card_hot.depth[index1] != card_hot.depth[index2]) return card_hot.depth[index1] < card_hot.depth[index2];
+    return index1 < index2;
+}
+
+// Keeps card_draw_order sorted back to front. Raising a card only moves it to the end of the list,
+// so the insertion sort here is a single pass in the usual case.
+// Depths are then renumbered to their place in the list so they stop growing with every click.
+void update_draw_order(CardPool& cards) {
+    if ((int) card_draw_order.size() != cards.active_cards) {
+        card_draw_order.clear();
+        for (auto it = begin(cards); it != end(cards); ++it) card_draw_order.push_back(it.index);
+        std::stable_sort(card_draw_order.begin(), card_draw_order.end(), [&](int index1, int index2) {
+            return card_hot.depth[index1] < card_hot.depth[index2];
+        });
+    } else {
+        bool sorted = true;
+        for (int i = 1; i < (int) card_draw_order.size(); i++) {
+            if (drawn_before(card_draw_order[i], card_draw_order[i - 1])) {
+                sorted = false;
+                break;
+            }
+        }
+        if (sorted && (card_draw_order.empty() || card_hot.depth[card_draw_order.back()] == cards.active_cards - 1)) return;
+        for (int i = 1; i < (int) card_draw_order.size(); i++) {
+            int index = card_draw_order[i];
+            int j = i;
+            while (j > 0 && drawn_before(index, card_draw_order[j - 1])) {
+                card_draw_order[j] = card_draw_order[j - 1];
+                j -= 1;
+            }
+            card_draw_order[j] = index;
+        }
+    }
+    for (int i = 0; i < (int) card_draw_order.size(); i++) {
+        card_hot.depth[card_draw_order[i]] = i;
+        pool_card(cards, card_draw_order[i]).depth = i;
     }
-    return depth;
 }
 
-bool operator==(Card c1, Card c2) {
+bool operator==(const Card& c1, const Card& c2) {
     return c1.id == c2.id;
 }
 
-void update_cards(std::vector<Card>& cards) {
-    cards.erase(std::remove_if(cards.begin(), cards.end(), [] (const auto &card) {return card.deleted;}), cards.end());
+bool operator==(CardHandle handle1, CardHandle handle2) {
+    return handle1.index == handle2.index && handle1.generation == handle2.generation;
+}
+
+bool operator!=(CardHandle handle1, CardHandle handle2) {
+    return !(handle1 == handle2);
+}
+
+static bool handle_is_live(CardHandle handle) {
+    return handle.index >= 0 && handle.index < (int) card_handles.generation.size() &&
+        card_handles.generation[handle.index] == handle.generation;
+}
+
+// Gives the card a handle if it doesn't have a live one yet. The handle only resolves once update_cards
+// has put the card on the board.
+CardHandle acquire_card_handle(Card& card) {
+    if (handle_is_live(card.handle)) return card.handle;
+    int index;
+    if (!card_handles.free_slots.empty()) {
+        index = card_handles.free_slots.back();
+        card_handles.free_slots.pop_back();
+    } else {
+        index = card_handles.generation.size();
+        card_handles.generation.push_back(0);
+        card_handles.position.push_back(-1);
+    }
+    card_handles.position[index] = -1;
+    card.handle = {index, card_handles.generation[index]};
+    return card.handle;
+}
+
+static void release_card_handle(Card& card) {
+    if (!handle_is_live(card.handle)) return;
+    card_handles.generation[card.handle.index] += 1;
+    card_handles.position[card.handle.index] = -1;
+    card_handles.free_slots.push_back(card.handle.index);
+    card.handle = NO_CARD;
+}
+
+Card* get_card(CardPool& cards, CardHandle handle) {
+    if (!handle_is_live(handle)) return NULL;
+    int position = card_handles.position[handle.index];
+    if (!slot_is_live(cards, position) || pool_card(cards, position).handle != handle) return NULL;
+    return &pool_card(cards, position);
+}
+
+static bool on_board(const Card& card) {
+    return card.slot >= 0 && card.slot < (int) card_hot.x.size() && !(card_hot.flags[card.slot] & CARD_UNUSED);
+}
+
+static void mark_slot_edited(int slot) {
+    // A slot card_hot doesn't cover yet has never had a card on the board.
+    if (slot >= (int) card_hot.flags.size() || (card_hot.flags[slot] & CARD_EDITED)) return;
+    card_hot.flags[slot] |= CARD_EDITED;
+    card_hot.edited.push_back(slot);
+}
+
+// Puts the card on card_hot.edited, so the journal looks at it. A card tucked under another one puts that one
+// there instead. Cards not on the board yet are looked at once update_cards adds them.
+void mark_card_edited(Card& card) {
+    if (on_board(card)) {
+        mark_slot_edited(card.slot);
+    } else if (handle_is_live(card.parent)) {
+        int slot = card_handles.position[card.parent.index];
+        if (slot >= 0 && slot < (int) card_hot.flags.size() && !(card_hot.flags[slot] & CARD_UNUSED)) mark_slot_edited(slot);
+    }
+}
+
+// Gives the card a content revision no other card has had, so anything keeping a copy of its text, name or
+// tone can tell it changed. Copies of a card share its revision, along with its text.
+void touch_card_content(Card& card) {
+    static unsigned int last_revision = 0;
+    last_revision += 1;
+    card.content_revision = last_revision;
+    mark_card_edited(card);
+}
+
+static void set_card_flag(Card& card, CardFlag flag, bool set) {
+    if (!on_board(card)) return;
+    if (set) card_hot.flags[card.slot] |= flag;
+    else card_hot.flags[card.slot] &= ~flag;
+}
+
+void set_card_fontsize(Card& card, FontSize fontsize) {
+    card.fontsize = fontsize;
+    mark_card_edited(card);
+    switch (fontsize) {
+    case SMALL:
+        card.font = &application_font_small;
+        break;
+    case REGULAR:
+        card.font = &application_font_regular;
+        break;
+    case LARGE:
+        card.font = &application_font_large;
+        break;
+    }
+}
+
+void set_card_rect(Card& card, Rectangle rect) {
+    card.body_rect = rect;
+    if (!on_board(card)) return;
+    card_hot.x[card.slot] = rect.x;
+    card_hot.y[card.slot] = rect.y;
+    card_hot.width[card.slot] = rect.width;
+    card_hot.height[card.slot] = rect.height;
+    card_hot.moved.push_back(card.slot);
+}
+
+void set_card_target(Card& card, Vector2 target) {
+    card.lock_target = target;
+    if (!on_board(card)) return;
+    card_hot.target_x[card.slot] = target.x;
+    card_hot.target_y[card.slot] = target.y;
+}
+
+void set_card_depth(Card& card, int depth) {
+    card.depth = depth;
+    if (on_board(card)) card_hot.depth[card.slot] = depth;
+}
+
+void set_card_grabbed(Card& card, bool grabbed) {
+    card.grabbed = grabbed;
+    set_card_flag(card, CARD_GRABBED, grabbed);
+}
+
+void set_card_selected(Card& card, bool selected) {
+    card.selected = selected;
+    set_card_flag(card, CARD_SELECTED, selected);
+}
+
+// Does nothing if the card already is, or isn't, deleted, so it isn't journaled for no reason.
+void set_card_deleted(Card& card, bool deleted) {
+    if (card.deleted == deleted) return;
+    card.deleted = deleted;
+    if (deleted && on_board(card) && !(card_hot.flags[card.slot] & CARD_DELETED)) card_hot.deleted.push_back(card.slot);
+    set_card_flag(card, CARD_DELETED, deleted);
+    mark_card_edited(card);
+}
+
+// Asserts that the card in pool slot `index` and its card_hot entry agree, which they do as long as board cards
+// are only changed through the set_card_* functions. Compiled out along with assert in NDEBUG builds.
+void check_card_hot(CardPool& cards, int index) {
+#ifndef NDEBUG
+    const auto &card = pool_card(cards, index);
+    unsigned char flags = card_hot.flags[index];
+    assert(card.slot == index && !(flags & CARD_UNUSED));
+    assert(card.body_rect.x == card_hot.x[index] && card.body_rect.y == card_hot.y[index] &&
+        card.body_rect.width == card_hot.width[index] && card.body_rect.height == card_hot.height[index]);
+    assert(card.lock_target.x == card_hot.target_x[index] && card.lock_target.y == card_hot.target_y[index]);
+    assert(card.depth == card_hot.depth[index]);
+    assert(card.grabbed == !!(flags & CARD_GRABBED) && card.selected == !!(flags & CARD_SELECTED) &&
+        card.deleted == !!(flags & CARD_DELETED) && (card.parent != NO_CARD) == !!(flags & CARD_ATTACHED));
+#endif
+}
+
+static void resize_card_hot(int count) {
+    int old_count = card_hot.x.size();
+    card_hot.x.resize(count);
+    card_hot.y.resize(count);
+    card_hot.width.resize(count);
+    card_hot.height.resize(count);
+    card_hot.target_x.resize(count);
+    card_hot.target_y.resize(count);
+    card_hot.depth.resize(count);
+    card_hot.flags.resize(count);
+    for (int i = old_count; i < count; i++) card_hot.flags[i] = CARD_UNUSED;
+}
+
+// Copies a card that was just added to the pool into card_hot.
+static void place_card(CardPool& cards, int i) {
+    auto &card = pool_card(cards, i);
+    // A copy of a card already on the board gets a handle of its own.
+    if (get_card(cards, card.handle) != NULL) card.handle = NO_CARD;
+    card_handles.position[acquire_card_handle(card).index] = i;
+    card.slot = i;
+    card_hot.x[i] = card.body_rect.x;
+    card_hot.y[i] = card.body_rect.y;
+    card_hot.width[i] = card.body_rect.width;
+    card_hot.height[i] = card.body_rect.height;
+    card_hot.target_x[i] = card.lock_target.x;
+    card_hot.target_y[i] = card.lock_target.y;
+    card_hot.depth[i] = card.depth;
+    card_hot.flags[i] = (card_hot.flags[i] & CARD_EDITED) | (card.grabbed ? CARD_GRABBED : 0) |
+        (card.selected ? CARD_SELECTED : 0) | (card.parent != NO_CARD ? CARD_ATTACHED : 0);
+    card_hot.moved.push_back(i);
+    if (card.deleted) {
+        card_hot.flags[i] |= CARD_DELETED;
+        card_hot.deleted.push_back(i);
+    }
+}
+
+static void take_card_off_board(CardPool& cards, int i) {
+    auto &card = pool_card(cards, i);
+    release_card_handle(card);
+    remove_from_spatial_grid(card_grid, i);
+    mark_slot_edited(i);
+    card_hot.flags[i] = CARD_UNUSED | CARD_EDITED;
+    remove_card(cards, i);
+}
+
+// Empties the board. Use this rather than clear_pool so handles and card_hot let go of the cards too.
+void clear_cards(CardPool& cards) {
+    for (auto it = begin(cards); it != end(cards); ++it) {
+        release_card_handle(*it);
+        remove_from_spatial_grid(card_grid, it.index);
+        mark_slot_edited(it.index);
+    }
+    clear_pool(cards);
+    for (auto &flags: card_hot.flags) flags = CARD_UNUSED | (flags & CARD_EDITED);
+    card_hot.moved.clear();
+    card_hot.deleted.clear();
+    card_draw_order.clear();
+}
+
+static void move_card_subparts(Card& card) {
+    card.header_rec = {card.body_rect.x,
+        card.body_rect.y - card.header_rec.height,
+        card.body_rect.width - 30, card.header_rec.height};
+    card.close_button.rect = {card.body_rect.x + card.body_rect.width - 20,
+        card.body_rect.y - 12, 33, 36};
+    card.edit_button.rect = {card.body_rect.x + card.body_rect.width - 50,
+        card.body_rect.y + card.body_rect.height - 47, 50,
+        30};
+    card.tone_button.rect = {card.edit_button.rect.x, card.edit_button.rect.y + 30, 50, 30};
+    card.increase_font_button.rect =
+        {card.edit_button.rect.x - 10 - 27, card.body_rect.y + card.body_rect.height - 36, 27, 27};
+    card.decrease_font_button.rect = 
+        {card.edit_button.rect.x - 10 - 56, card.body_rect.y + card.body_rect.height - 36, 27, 27};
+    card.scene_insert_button.rect = {card.body_rect.x + card.body_rect.width - (17 * 3) / 2 - 9, card.body_rect.y + card.body_rect.height - 13 * 3 - 100, 17 * 3, 13 * 3};
+    card.scene_remove_button.rect = {card.body_rect.x + card.body_rect.width - (17 * 3) / 2 - 15, card.body_rect.y + card.body_rect.height - 13 * 3 - 50, 17 * 3, 13 * 3};
+}
+
+// Returns true if any card moved or resized, so the caller knows the board hasn't settled yet.
+// The tween only reads and writes card_hot. Card mirrors, buttons and the spatial grid are only touched for
+// the cards that actually moved.
+bool update_cards(CardPool& cards) {
+    // Deleted cards give their slot back to the pool. Cards added since the last update take a slot on the board.
+    for (auto i: card_hot.deleted) {
+        if (!(card_hot.flags[i] & CARD_DELETED)) continue; // Undeleted before it was taken off
+        take_card_off_board(cards, i);
+        card_draw_order.clear();
+    }
+    card_hot.deleted.clear();
+    int count = cards.capacity;
+    resize_card_hot(count);
+    for (auto i: cards.added) {
+        if (!slot_is_live(cards, i)) continue;
+        place_card(cards, i);
+        card_draw_order.clear();
+    }
+    cards.added.clear();
+    update_draw_order(cards);
+
     // Tween cards
-    for (auto &card : cards) {
-        if (card.parent) {
-            // TODO: TWWWWWEEEN
-            card.body_rect.x = card.parent->body_rect.x;
-            card.body_rect.y = card.parent->body_rect.y;
-            card.body_rect.width = 5;
-            card.body_rect.height = 5;
-            continue;
-        }
-        if (card.grabbed)
+    for (int i = 0; i < count; i++) {
+        if (card_hot.flags[i] & (CARD_ATTACHED | CARD_GRABBED | CARD_UNUSED))
             continue;
-        if (!card.selected) {
-            card.body_rect.x =
-                lerp<float>(card.body_rect.x, card.lock_target.x, 0.2);
-            card.body_rect.y =
-                lerp<float>(card.body_rect.y, card.lock_target.y, 0.2);
-            auto closeness = (Vector2){card.body_rect.x, card.body_rect.y} -
-                             card.lock_target;
-            if (!(closeness.x < 0.02 && closeness.y < 0.02))
-              continue; // Basically make sure we finish moving before we resize
-                        // the card.
-            Vector2 corner_coords = {card.body_rect.x + card.body_rect.width,
-                                     card.body_rect.y + card.body_rect.height};
-            card.body_rect.width = lerp<float>(
-                card.body_rect.width,
-                lock_position_to_grid(corner_coords).x - card.body_rect.x, 0.2);
-            card.body_rect.height = lerp<float>(
-                card.body_rect.height,
-                lock_position_to_grid(corner_coords).y - card.body_rect.y, 0.2);
+        float x = card_hot.x[i];
+        float y = card_hot.y[i];
+        float width = card_hot.width[i];
+        float height = card_hot.height[i];
+        if (!(card_hot.flags[i] & CARD_SELECTED)) {
+            x = lerp<float>(x, card_hot.target_x[i], 0.2);
+            y = lerp<float>(y, card_hot.target_y[i], 0.2);
+            // Basically make sure we finish moving before we resize the card.
+            if (x - card_hot.target_x[i] < 0.02 && y - card_hot.target_y[i] < 0.02) {
+                auto corner = lock_position_to_grid((Vector2) {x + width, y + height});
+                width = lerp<float>(width, corner.x - x, 0.2);
+                height = lerp<float>(height, corner.y - y, 0.2);
+            }
         } else {
-            card.body_rect.x = card.lock_target.x;
-            card.body_rect.y = card.lock_target.y;
+            x = card_hot.target_x[i];
+            y = card_hot.target_y[i];
         }
+        if (x == card_hot.x[i] && y == card_hot.y[i] && width == card_hot.width[i] && height == card_hot.height[i]) continue;
+        card_hot.x[i] = x;
+        card_hot.y[i] = y;
+        card_hot.width[i] = width;
+        card_hot.height[i] = height;
+        card_hot.moved.push_back(i);
     }
-    for (auto &card: cards) {
+
+    // Keep the spatial index in step with where the cards ended up this frame.
+    resize_spatial_grid(card_grid, count);
+    for (auto i: card_hot.moved) {
+        if (card_hot.flags[i] & CARD_UNUSED) continue;
+        auto &card = pool_card(cards, i);
+        card.body_rect = {card_hot.x[i], card_hot.y[i], card_hot.width[i], card_hot.height[i]};
+        mark_slot_edited(i);
         /// Move subparts of cards
-        card.header_rec = {card.body_rect.x,
-            card.body_rect.y - card.header_rec.height,
-            card.body_rect.width - 30, card.header_rec.height};
-        card.close_button.rect = {card.body_rect.x + card.body_rect.width - 20,
-            card.body_rect.y - 12, 33, 36};
-        card.edit_button.rect = {card.body_rect.x + card.body_rect.width - 50,
-            card.body_rect.y + card.body_rect.height - 47, 50,
-            30};
-        card.tone_button.rect = {card.edit_button.rect.x, card.edit_button.rect.y + 30, 50, 30};
-        card.increase_font_button.rect =
-            {card.edit_button.rect.x - 10 - 27, card.body_rect.y + card.body_rect.height - 36, 27, 27};
-        card.decrease_font_button.rect = 
-            {card.edit_button.rect.x - 10 - 56, card.body_rect.y + card.body_rect.height - 36, 27, 27};
-        card.scene_insert_button.rect = {card.body_rect.x + card.body_rect.width - (17 * 3) / 2 - 9, card.body_rect.y + card.body_rect.height - 13 * 3 - 100, 17 * 3, 13 * 3};
-        card.scene_remove_button.rect = {card.body_rect.x + card.body_rect.width - (17 * 3) / 2 - 15, card.body_rect.y + card.body_rect.height - 13 * 3 - 50, 17 * 3, 13 * 3};
+        move_card_subparts(card);
+        if (card_hot.flags[i] & CARD_ATTACHED) {
+            remove_from_spatial_grid(card_grid, i);
+            continue;
+        }
+        update_spatial_grid(card_grid, i, card_hit_bounds(card));
+    }
+    bool moved = !card_hot.moved.empty();
+    card_hot.moved.clear();
+    return moved;
+}
+
+// Area covered by the card and the buttons that stick out of its corners.
+Rectangle card_hit_bounds(const Card& card) {
+    #define CARD_HIT_MARGIN 24
+    return {card.body_rect.x - CARD_HIT_MARGIN, card.body_rect.y - CARD_HIT_MARGIN,
+        card.body_rect.width + CARD_HIT_MARGIN * 2, card.body_rect.height + CARD_HIT_MARGIN * 2};
+    #undef CARD_HIT_MARGIN
+}
+
+// Area anything belonging to the card can be drawn in. Only hovered cards draw outside their body: the buttons
+// and the stack of scenes peeking out of an event.
+Rectangle card_draw_bounds(const Card& card) {
+    if (!card.hover) return card.body_rect;
+    #define CARD_DRAW_MARGIN 48
+    return {card.body_rect.x - CARD_DRAW_MARGIN, card.body_rect.y - CARD_DRAW_MARGIN,
+        card.body_rect.width + CARD_DRAW_MARGIN * 2, card.body_rect.height + CARD_DRAW_MARGIN * 2};
+    #undef CARD_DRAW_MARGIN
+}
+
+// Topmost card under `position`. Ties in depth go to the card in the later pool slot, since that one is drawn last.
+Card* card_at(CardPool& cards, Vector2 position) {
+    static std::vector<int> candidates;
+    candidates.clear();
+    query_spatial_grid(card_grid, position, candidates);
+
+    int found = -1;
+    for (auto index: candidates) {
+        if (index >= (int) card_hot.x.size()) continue; // The board changed since the last update_cards
+        if (card_hot.flags[index] & (CARD_ATTACHED | CARD_UNUSED)) continue;
+        if (position.x < card_hot.x[index] || position.x > card_hot.x[index] + card_hot.width[index] ||
+            position.y < card_hot.y[index] || position.y > card_hot.y[index] + card_hot.height[index]) continue;
+        int depth = card_hot.depth[index];
+        if (found == -1 || depth > card_hot.depth[found] || (depth == card_hot.depth[found] && index > found)) {
+            found = index;
+        }
     }
+    return found == -1 ? NULL : &pool_card(cards, found);
 }
 
 void draw_resize_corner(const Card& card) {
@@ -155,110 +479,86 @@ void draw_resize_corner(const Card& card) {
 void draw_card_ui(Card &card, Camera2D camera) {
     // Draw close button
     /// Draw close texture
-    auto close_button_position = (Vector2) {-card.close_button.rect.x, -card.close_button.rect.y};
-    DrawTextureTiled(*card.textures, (Rectangle) {32, 0, 11, 12}, (Rectangle) {0, 0, 33, 36}, close_button_position, 0.0, 3.0, WHITE);
+    draw_sprite(*card.textures, (Rectangle) {32, 0, 11, 12}, (Rectangle) {card.close_button.rect.x, card.close_button.rect.y, 33, 36});
 
     // Draw Card Edit Button
     /// Draw Button Base
-    DrawTexturePro(*card.textures, (Rectangle) {43, 0, 7, 10}, (Rectangle) {card.edit_button.rect.x, card.edit_button.rect.y, 21, 30}, (Vector2) {0, 0}, 0.0, WHITE);
-    DrawTexturePro(*card.textures, (Rectangle) {50, 0, 1, 10}, (Rectangle) {card.edit_button.rect.x + 21, card.edit_button.rect.y, 63, 30}, (Vector2) {0, 0}, 0.0, WHITE);
-    DrawTexturePro(*card.textures, (Rectangle) {51, 0, 8, 10}, (Rectangle) {card.edit_button.rect.x + 84, card.edit_button.rect.y, 24, 30}, (Vector2) {0, 0}, 0.0, WHITE);
-    DrawTexturePro(*card.textures, (Rectangle) {77, 0, 17, 5}, (Rectangle) {card.edit_button.rect.x + 27, card.edit_button.rect.y + 6, 51, 15}, (Vector2) {0, 0}, 0.0, WHITE);
+    draw_sprite(*card.textures, (Rectangle) {43, 0, 7, 10}, (Rectangle) {card.edit_button.rect.x, card.edit_button.rect.y, 21, 30});
+    draw_sprite(*card.textures, (Rectangle) {50, 0, 1, 10}, (Rectangle) {card.edit_button.rect.x + 21, card.edit_button.rect.y, 63, 30});
+    draw_sprite(*card.textures, (Rectangle) {51, 0, 8, 10}, (Rectangle) {card.edit_button.rect.x + 84, card.edit_button.rect.y, 24, 30});
+    draw_sprite(*card.textures, (Rectangle) {77, 0, 17, 5}, (Rectangle) {card.edit_button.rect.x + 27, card.edit_button.rect.y + 6, 51, 15});
 
     /// Draw Button Text
-    DrawTexturePro(*card.textures, (Rectangle) {43, 0, 7, 10}, (Rectangle) {card.tone_button.rect.x, card.tone_button.rect.y, 21, 30}, (Vector2) {0, 0}, 0.0, WHITE);
-    DrawTexturePro(*card.textures, (Rectangle) {50, 0, 1, 10}, (Rectangle) {card.tone_button.rect.x + 21, card.tone_button.rect.y, 63, 30}, (Vector2) {0, 0}, 0.0, WHITE);
-    DrawTexturePro(*card.textures, (Rectangle) {51, 0, 8, 10}, (Rectangle) {card.tone_button.rect.x + 84, card.tone_button.rect.y, 24, 30}, (Vector2) {0, 0}, 0.0, WHITE);
-    DrawTexturePro(*card.textures, (Rectangle) {77, 5, 17, 5}, (Rectangle) {card.tone_button.rect.x + 27, card.tone_button.rect.y + 6, 51, 15}, (Vector2) {0, 0}, 0.0, WHITE);
+    draw_sprite(*card.textures, (Rectangle) {43, 0, 7, 10}, (Rectangle) {card.tone_button.rect.x, card.tone_button.rect.y, 21, 30});
+    draw_sprite(*card.textures, (Rectangle) {50, 0, 1, 10}, (Rectangle) {card.tone_button.rect.x + 21, card.tone_button.rect.y, 63, 30});
+    draw_sprite(*card.textures, (Rectangle) {51, 0, 8, 10}, (Rectangle) {card.tone_button.rect.x + 84, card.tone_button.rect.y, 24, 30});
+    draw_sprite(*card.textures, (Rectangle) {77, 5, 17, 5}, (Rectangle) {card.tone_button.rect.x + 27, card.tone_button.rect.y + 6, 51, 15});
 
     // Draw Font increase buttons
-    DrawTexturePro(*card.textures, (Rectangle) {59, 0, 9, 9}, (Rectangle) {card.increase_font_button.rect.x, card.increase_font_button.rect.y, 27, 27}, (Vector2) {0, 0}, 0.0, WHITE);
-    DrawTexturePro(*card.textures, (Rectangle) {68, 0, 9, 9}, (Rectangle) {card.decrease_font_button.rect.x, card.decrease_font_button.rect.y, 27, 27}, (Vector2) {0, 0}, 0.0, WHITE);
+    draw_sprite(*card.textures, (Rectangle) {59, 0, 9, 9}, (Rectangle) {card.increase_font_button.rect.x, card.increase_font_button.rect.y, 27, 27});
+    draw_sprite(*card.textures, (Rectangle) {68, 0, 9, 9}, (Rectangle) {card.decrease_font_button.rect.x, card.decrease_font_button.rect.y, 27, 27});
 }
 
 void draw_card_body(float x, float y, float width, float height, bool light) {
     // Draw Body
-    DrawRectangleRec((Rectangle) {x + 3, y + 3, width - 3, height - 3}, light ? CARDWHITE : CARDBLACK);
-    auto top_left     = (Vector2) {-x, -y};
-    auto top_right    = (Vector2) {-x - width + 12, -y};
-    auto bottom_left  = (Vector2) {-x, -y - height + 12};
-    auto bottom_right = (Vector2) {-x - width + 12, -y -height + 12};
-    if (light) {
-        DrawTexturePro(spritesheet, (Rectangle) {0, 0, 4, 4}, (Rectangle) {0, 0, 12, 12}, top_left, 0.0, WHITE);
-        DrawTexturePro(spritesheet, (Rectangle) {12, 0, 4, 4}, (Rectangle) {0, 0, 12, 12}, top_right, 0.0, WHITE);
-        DrawTexturePro(spritesheet, (Rectangle) {0, 12, 4, 4}, (Rectangle) {0, 0, 12, 12}, bottom_left, 0.0, WHITE);
-        DrawTexturePro(spritesheet, (Rectangle) {12, 12, 4, 4}, (Rectangle) {0, 0, 12, 12}, bottom_right, 0.0, WHITE);
-
-        // Horizontal bars
-        DrawTexturePro(spritesheet, (Rectangle) {4, 0, 8, 3}, (Rectangle) {0, 0, (width - 24), 9}, (Vector2) {-x - 12, -y}, 0.0, WHITE);
-        DrawTexturePro(spritesheet, (Rectangle) {4, 13, 8, 3}, (Rectangle) {0, 0, (width - 24), 9}, (Vector2) {-x - 12, -y - height + 9}, 0.0, WHITE);
-
-        // Vertical bars
-        DrawTexturePro(spritesheet, (Rectangle) {0, 4, 3, 8}, (Rectangle) {0, 0, 9, height - 20}, (Vector2) {-x, -y - 9}, 0.0, WHITE);
-        DrawTexturePro(spritesheet, (Rectangle) {13, 4, 3, 8}, (Rectangle) {0, 0, 9, height - 20}, (Vector2) {-x - width + 9, -y - 9}, 0.0, WHITE);
-
-    } else {
-        DrawTexturePro(spritesheet, (Rectangle) {16, 0, 4, 4}, (Rectangle) {0, 0, 12, 12}, top_left, 0.0, WHITE);
-        DrawTexturePro(spritesheet, (Rectangle) {12 + 16, 0, 4, 4}, (Rectangle) {0, 0, 12, 12}, top_right, 0.0, WHITE);
-        DrawTexturePro(spritesheet, (Rectangle) {16, 12, 4, 4}, (Rectangle) {0, 0, 12, 12}, bottom_left, 0.0, WHITE);
-        DrawTexturePro(spritesheet, (Rectangle) {12 + 16, 12, 4, 4}, (Rectangle) {0, 0, 12, 12}, bottom_right, 0.0, WHITE);
-
-        // Horizontal bars
-        DrawTexturePro(spritesheet, (Rectangle) {4 + 16, 0, 8, 3}, (Rectangle) {0, 0, (width - 24), 9}, (Vector2) {-x - 12, -y}, 0.0, WHITE);
-        DrawTexturePro(spritesheet, (Rectangle) {4 + 16, 13, 8, 3}, (Rectangle) {0, 0, (width - 24), 9}, (Vector2) {-x - 12, -y - height + 9}, 0.0, WHITE);
-
-        // Vertical bars
-        DrawTexturePro(spritesheet, (Rectangle) {16, 4, 3, 8}, (Rectangle) {0, 0, 9, height - 20}, (Vector2) {-x, -y - 9}, 0.0, WHITE);
-        DrawTexturePro(spritesheet, (Rectangle) {13 + 16, 4, 3, 8}, (Rectangle) {0, 0, 9, height - 20}, (Vector2) {-x - width + 9, -y - 9}, 0.0, WHITE);
-    }
+    draw_sprite_rect((Rectangle) {x + 3, y + 3, width - 3, height - 3}, light ? CARDWHITE : CARDBLACK);
+    float u = light ? 0 : 16; // The dark card sits right of the light one on the spritesheet
+    draw_sprite(spritesheet, (Rectangle) {u, 0, 4, 4}, (Rectangle) {x, y, 12, 12});
+    draw_sprite(spritesheet, (Rectangle) {u + 12, 0, 4, 4}, (Rectangle) {x + width - 12, y, 12, 12});
+    draw_sprite(spritesheet, (Rectangle) {u, 12, 4, 4}, (Rectangle) {x, y + height - 12, 12, 12});
+    draw_sprite(spritesheet, (Rectangle) {u + 12, 12, 4, 4}, (Rectangle) {x + width - 12, y + height - 12, 12, 12});
+
+    // Horizontal bars
+    draw_sprite(spritesheet, (Rectangle) {u + 4, 0, 8, 3}, (Rectangle) {x + 12, y, width - 24, 9});
+    draw_sprite(spritesheet, (Rectangle) {u + 4, 13, 8, 3}, (Rectangle) {x + 12, y + height - 9, width - 24, 9});
+
+    // Vertical bars
+    draw_sprite(spritesheet, (Rectangle) {u, 4, 3, 8}, (Rectangle) {x, y + 9, 9, height - 20});
+    draw_sprite(spritesheet, (Rectangle) {u + 13, 4, 3, 8}, (Rectangle) {x + width - 9, y + 9, 9, height - 20});
 }
 
 void draw_card_body(Rectangle rect, bool light) {
     draw_card_body(rect.x, rect.y, rect.width, rect.height, light);
 }
 
-void draw(Card &card, Camera2D camera) {
-    if (card.parent != NULL) {
-        card.drawn = true;
-        return;
-    }
-
-    Defer {card.drawn = true;};
-
-    auto position = GetScreenToWorld2D(GetMousePosition(), camera);
-
+// Everything on a card that doesn't depend on the player interacting with it, apart from the caret and selection
+// of the text being written, if it's `editing`.
+void draw_card_face(Card &card, const TextBuffer *editing) {
+    set_sprite_layer(sprite_batch, SPRITE_LAYER_UNDER);
     draw_card_body(card.body_rect.x, card.body_rect.y, card.body_rect.width, card.body_rect.height, card.tone == LIGHT);
     // Draw Card Content
-    auto content = std::vector<char>();
-    for (auto &c: card.content) {
-        content.push_back((char) c);
+    Rectangle text_rect = {card.body_rect.x + 9, card.body_rect.y + 30, card.body_rect.width - 21, card.body_rect.height - 39};
+    float font_size = get_font_size(card.font);
+    bool centered = card.type != SCENE;
+    float spacing = centered ? 0.25 : 0.15;
+    if (!text_layout_matches(card.layout, *card.font, card.content_revision, font_size, spacing, text_rect.width, true, centered)) {
+        layout_text_rec(card.layout, *card.font, card.content, card.content_revision, font_size, spacing, text_rect.width, true, centered);
     }
-    content.push_back((char) '\0');
-    card.body_rect.x += 9;
-    card.body_rect.y += 30;
-    card.body_rect.width -= 21;
-    card.body_rect.height -= 39;
-    if (card.type != SCENE) {
-        draw_text_rec_justified(*card.font, content.data(), card.body_rect, get_font_size(card.font), 0.25, true, card.tone == LIGHT ? BLACK : WHITE);
+    Color text_tint = card.tone == LIGHT ? BLACK : WHITE;
+    if (editing == NULL) {
+        set_sprite_layer(sprite_batch, SPRITE_LAYER_TEXT);
+        draw_text_layout(card.layout, *card.font, text_rect, text_tint);
     } else {
-        DrawTextRec(*card.font, content.data(), card.body_rect, get_font_size(card.font), 0.15, true, card.tone == LIGHT ? BLACK : WHITE);
-    }
-    card.body_rect.x -= 9;
-    card.body_rect.y -= 30;
-    card.body_rect.width += 21;
-    card.body_rect.height += 39;
-
-    // Draw Selection outline
-    if (card.selected) {
-        DrawRectangleLinesEx(card.body_rect, 5.0, BLUE);
+        // Selected text swaps colours with the card.
+        int select_start = codepoint_index(*editing, selection_start(*editing));
+        int select_length = codepoint_index(*editing, selection_end(*editing)) - select_start;
+        set_sprite_layer(sprite_batch, SPRITE_LAYER_SELECTION);
+        draw_text_layout_selection(card.layout, *card.font, text_rect, select_start, select_length, text_tint);
+        auto caret = text_layout_caret(card.layout, *card.font, codepoint_index(*editing, editing->caret));
+        if (caret.y + font_size <= text_rect.height) {
+            draw_sprite_rect({text_rect.x + caret.x - 1, text_rect.y + caret.y, 2, font_size}, text_tint);
+        }
+        set_sprite_layer(sprite_batch, SPRITE_LAYER_TEXT);
+        draw_text_layout(card.layout, *card.font, text_rect, text_tint, select_start, select_length, card.tone == LIGHT ? CARDWHITE : CARDBLACK);
     }
+    set_sprite_layer(sprite_batch, SPRITE_LAYER_OVER);
 
     // NOTE: Remember, we scale every pixel asset by 3x!
     // TODO: Maybe make it so we don't have to manually calculate `rect` offsets?
     switch (card.type) {
     case PERIOD: {
         Rectangle rect = {card.body_rect.x + (card.body_rect.width / 2 - 31), card.body_rect.y + 9, 21 * 3, 4 * 3};
-        DrawTexturePro(*card.textures, (Rectangle) {94, 0, 21, 4}, rect, (Vector2) {0, 0}, 0.0, WHITE);
+        draw_sprite(*card.textures, (Rectangle) {94, 0, 21, 4}, rect);
         if (card.is_beginning) {
             draw_texture_rect_scaled(*card.textures, {0, 48, 16, 16}, {card.body_rect.x + card.body_rect.width / 2 - ((16 * 3) / 2), card.body_rect.y + card.body_rect.height - 16 * 3 - 9});
         } else if (card.is_end) {
@@ -268,7 +568,7 @@ void draw(Card &card, Camera2D camera) {
     }
     case EVENT: {
         Rectangle rect = {card.body_rect.x + (card.body_rect.width / 2 - 28), card.body_rect.y + 9, 19 * 3, 4 * 3};
-        DrawTexturePro(*card.textures, (Rectangle) {94, 4, 19, 4}, rect, (Vector2) {0, 0}, 0.0, WHITE);
+        draw_sprite(*card.textures, (Rectangle) {94, 4, 19, 4}, rect);
 
         // Draw a tiny circle at the bottom if there are cards under this.
 
@@ -279,15 +579,26 @@ void draw(Card &card, Camera2D camera) {
     }
     case SCENE: {
         Rectangle rect = {card.body_rect.x + (card.body_rect.width / 2 - 28), card.body_rect.y + 9, 19 * 3, 4 * 3};
-        DrawTexturePro(*card.textures, (Rectangle) {94, 8, 19, 4}, rect, (Vector2) {0, 0}, 0.0, WHITE);
+        draw_sprite(*card.textures, (Rectangle) {94, 8, 19, 4}, rect);
         break;
     }
     case LEGACY: {
         Rectangle rect = {card.body_rect.x + (card.body_rect.width / 2 - 34), card.body_rect.y + 9, 23 * 3, 4 * 3};
-        DrawTexturePro(*card.textures, (Rectangle) {94, 12, 23, 4}, rect, (Vector2) {0, 0}, 0.0, WHITE);
+        draw_sprite(*card.textures, (Rectangle) {94, 12, 23, 4}, rect);
         break;
     }
     }
+}
+
+void draw(Card &card, Camera2D camera, const TextBuffer *editing) {
+    if (card.parent != NO_CARD) return;
+
+    draw_card_face(card, editing);
+
+    // Draw Selection outline
+    if (card.selected) {
+        draw_sprite_rect_lines(card.body_rect, 5.0, BLUE);
+    }
 
     if (card.draw_resize) draw_resize_corner(card);
 
@@ -314,7 +625,7 @@ void draw(Card &card, Camera2D camera) {
             auto text_width = MeasureTextEx(application_font_small, std::to_string(card.cards_under.size()).c_str(), 30.0, 1.0);
             auto offset_x = ((14 * 3) - text_width.x) / 2.0;
             auto offset_y = ((31 * 3) - text_width.y) / 2.0;
-            DrawTextEx(application_font_small, std::to_string(card.cards_under.size()).c_str(), card_back_pos + (Vector2) {offset_x, offset_y}, 30.0, 1.0, BLACK);
+            draw_sprite_text(application_font_small, std::to_string(card.cards_under.size()).c_str(), card_back_pos + (Vector2) {offset_x, offset_y}, 30.0, 1.0, BLACK);
         }
 
         // Draw In Arrow
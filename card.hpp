@@ -1,5 +1,9 @@
 #pragma once
 #include "common.hpp"
+#include "spatial_grid.hpp"
+
+struct CardPool;
+struct TextBuffer;
 
 enum CardType {
     PERIOD,
@@ -19,14 +23,72 @@ enum FontSize {
     LARGE
 };
 
+// Refers to a card on the board. The card pool hands a deleted card's slot to the next new card, so a plain
+// pointer or slot index can end up naming a different card. Resolve with get_card, which returns NULL instead.
+struct CardHandle {
+    int index; // Into card_handles
+    unsigned int generation;
+};
+
+const CardHandle NO_CARD = {-1, 0};
+
+bool operator==(CardHandle handle1, CardHandle handle2);
+bool operator!=(CardHandle handle1, CardHandle handle2);
+
+// Which pool slot each handle's card sits in. A slot's generation is bumped when its card is
+// deleted, so old handles to it stop resolving, and the slot goes on the free list for the next new card.
+struct CardHandleTable {
+    std::vector<int> position; // -1 until update_cards puts the card on the board
+    std::vector<unsigned int> generation;
+    std::vector<int> free_slots;
+};
+
+// Per-frame state of every card on the board, one array per field and indexed by pool slot, so passes
+// over the whole board only walk contiguous floats. Card keeps a copy of each field for everything else to read.
+// Cards on the board must be changed through the set_card_* functions below so both stay in step; check_card_hot
+// asserts that they did.
+enum CardFlag {
+    CARD_GRABBED  = 1 << 0,
+    CARD_SELECTED = 1 << 1,
+    CARD_DELETED  = 1 << 2,
+    CARD_ATTACHED = 1 << 3, // Tucked under another card, so not on the board itself
+    CARD_UNUSED   = 1 << 4, // No card in this pool slot
+    CARD_EDITED   = 1 << 5, // On `edited`. Kept when the slot's card is taken off the board
+};
+
+struct CardHotStore {
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> width;
+    std::vector<float> height;
+    std::vector<float> target_x;
+    std::vector<float> target_y;
+    std::vector<int> depth;
+    std::vector<unsigned char> flags;
+    std::vector<int> moved; // Cards that moved or resized since the last update_cards
+    std::vector<int> deleted; // Cards update_cards has to take off the board
+    std::vector<int> edited; // Slots whose card may differ from its save since journal_changes last looked
+};
+
+// Where a lazily loaded card's content and cards_under still are. `save` is -1 once they've been read, and for
+// every card that wasn't loaded lazily.
+struct LazyCard {
+    int save;
+    unsigned int record;
+};
+
 struct Card {
     std::string name;
     std::string content;
     std::string last_name;
     std::string last_content;
     std::vector<Card> cards_under;
-    Card *parent;
+    CardHandle parent; // Card this one is tucked under, if any
+    CardHandle handle;
     std::string id;
+    unsigned int content_revision; // Changes whenever `content`, `name` or `tone` is edited
+    int slot; // Pool slot, and index into card_hot, or -1 while the card isn't on the board
+    LazyCard lazy;
     int depth;
 
     Texture2D *textures;
@@ -40,7 +102,6 @@ struct Card {
     bool hover;
     bool draw_resize;
 
-    bool drawn;
     bool in_drawer;
     bool is_beginning;
     bool is_end;
@@ -50,6 +111,7 @@ struct Card {
     Vector2 saved_dimensions;
 
     Rectangle header_rec;
+    TextLayout layout; // Cached layout of `content`, rebuilt by draw when content_revision, the font or the width changes
 
     Button close_button;
     Button edit_button;
@@ -63,13 +125,40 @@ struct Card {
     Button remove_from_drawer_button;
 };
 
-bool operator==(Card c1, Card c2);
+bool operator==(const Card& c1, const Card& c2);
 Card init_card(std::string name, Rectangle body_rect, CardType type = PERIOD);
-Card* greatest_depth_and_furthest_along(std::vector<Card>& cards);
-void update_cards(std::vector<Card>& cards);
+Card* greatest_depth_and_furthest_along(CardPool& cards);
+bool update_cards(CardPool& cards);
 void draw_card_body(float x, float y, float width, float height, bool light);
 void draw_card_body(Rectangle rect, bool light);
 void draw_card_ui(Card &card, Camera2D camera);
-void draw(Card &card, Camera2D camera);
+void draw_card_face(Card &card, const TextBuffer *editing = NULL);
+void draw(Card &card, Camera2D camera, const TextBuffer *editing = NULL);
 void draw_resize_corner(const Card& card);
-int smallest_depth(const std::vector<Card>& cards);
+void update_draw_order(CardPool& cards);
+void clear_cards(CardPool& cards);
+Rectangle card_hit_bounds(const Card& card);
+Rectangle card_draw_bounds(const Card& card);
+Card* card_at(CardPool& cards, Vector2 position);
+CardHandle acquire_card_handle(Card& card);
+Card* get_card(CardPool& cards, CardHandle handle);
+
+void touch_card_content(Card& card);
+void mark_card_edited(Card& card);
+void set_card_fontsize(Card& card, FontSize fontsize);
+void set_card_rect(Card& card, Rectangle rect);
+void set_card_target(Card& card, Vector2 target);
+void set_card_depth(Card& card, int depth);
+void set_card_grabbed(Card& card, bool grabbed);
+void set_card_selected(Card& card, bool selected);
+void set_card_deleted(Card& card, bool deleted);
+void check_card_hot(CardPool& cards, int index);
+
+// Index of every card on the board, keyed by pool slot. Kept in sync by update_cards.
+extern SpatialGrid card_grid;
+// Pool slots from back to front. Kept in order by update_cards.
+extern std::vector<int> card_draw_order;
+// Position, size, depth and flags of the cards on the board. Cards are added and removed by update_cards.
+extern CardHotStore card_hot;
+// Handles of the cards on the board. Positions are filled in by update_cards when a card is added.
+extern CardHandleTable card_handles;
@@ -0,0 +1,232 @@
+#include "card_cache.hpp"
+#include "common.hpp"
+#include "card.hpp"
+#include "sprite_batch.hpp"
+
+static float cache_scale(Camera2D camera) {
+    // Quarter steps, so a zoom tween doesn't produce a new scale every frame.
+    float scale = ceilf(camera.zoom * 4.0) / 4.0;
+    return scale < 0.25 ? 0.25 : scale;
+}
+
+static CardFaceKey make_face_key(const Card& card, float scale) {
+    CardFaceKey key;
+    key.content_revision = card.content_revision;
+    key.width = card.body_rect.width;
+    key.height = card.body_rect.height;
+    key.font_size = get_font_size(card.font);
+    key.scale = scale;
+    key.type = card.type;
+    key.tone = card.tone;
+    key.is_beginning = card.is_beginning;
+    key.is_end = card.is_end;
+    key.has_cards_under = !card.cards_under.empty();
+    return key;
+}
+
+static bool face_key_matches(const CardFaceKey& key, const Card& card, float scale) {
+    return key.content_revision == card.content_revision && key.width == card.body_rect.width && key.height == card.body_rect.height &&
+        key.font_size == get_font_size(card.font) && key.scale == scale &&
+        key.type == card.type && key.tone == card.tone &&
+        key.is_beginning == card.is_beginning && key.is_end == card.is_end &&
+        key.has_cards_under == !card.cards_under.empty();
+}
+
+static size_t page_bytes(const CardCachePage& page) {
+    return (size_t) page.texture.texture.width * page.texture.texture.height * 4;
+}
+
+static int round_up_to_slot(float size) {
+    return ((int) ceilf(size) + CARD_CACHE_SLOT_STEP - 1) / CARD_CACHE_SLOT_STEP * CARD_CACHE_SLOT_STEP;
+}
+
+static void release_slot(CardTextureCache& cache, CachedCard& entry) {
+    if (entry.page == -1) return;
+    auto &page = cache.pages[entry.page];
+    page.free_slots.push_back(entry.slot);
+    entry.page = -1;
+    if ((int) page.free_slots.size() == page.columns * page.rows) {
+        cache.bytes_used -= page_bytes(page);
+        UnloadRenderTexture(page.texture);
+        page.loaded = false;
+        page.free_slots.clear();
+    }
+}
+
+// Drops the least recently drawn entry. Returns false if that would mean dropping something drawn this frame.
+static bool evict_one(CardTextureCache& cache) {
+    if (cache.lru.empty()) return false;
+    auto found = cache.entries.find(cache.lru.back());
+    if (found->second.last_used_frame == cache.frame) return false;
+    release_slot(cache, found->second);
+    cache.entries.erase(found);
+    cache.lru.pop_back();
+    return true;
+}
+
+static int load_page(CardTextureCache& cache, int slot_width, int slot_height) {
+    CardCachePage page;
+    page.columns = CARD_CACHE_PAGE_SIZE / slot_width;
+    page.rows = CARD_CACHE_PAGE_SIZE / slot_height;
+    page.slot_width = slot_width;
+    page.slot_height = slot_height;
+    page.texture = LoadRenderTexture(page.columns * slot_width, page.rows * slot_height);
+    page.loaded = true;
+    page.free_slots = std::vector<int>();
+    for (int slot = page.columns * page.rows - 1; slot >= 0; slot--) page.free_slots.push_back(slot);
+    BeginTextureMode(page.texture);
+    ClearBackground(BLANK);
+    EndTextureMode();
+    cache.bytes_used += page_bytes(page);
+
+    for (int i = 0; i < (int) cache.pages.size(); i++) {
+        if (cache.pages[i].loaded) continue;
+        cache.pages[i] = page;
+        return i;
+    }
+    cache.pages.push_back(page);
+    return cache.pages.size() - 1;
+}
+
+// Finds a free slot of the right size, making room under the budget if needed.
+static bool allocate_slot(CardTextureCache& cache, CachedCard& entry, float width, float height) {
+    int slot_width = round_up_to_slot(width);
+    int slot_height = round_up_to_slot(height);
+    if (slot_width > CARD_CACHE_PAGE_SIZE || slot_height > CARD_CACHE_PAGE_SIZE) return false;
+    while (true) {
+        for (int i = 0; i < (int) cache.pages.size(); i++) {
+            auto &page = cache.pages[i];
+            if (!page.loaded || page.slot_width != slot_width || page.slot_height != slot_height || page.free_slots.empty()) continue;
+            entry.page = i;
+            entry.slot = page.free_slots.back();
+            page.free_slots.pop_back();
+            return true;
+        }
+        size_t bytes = (size_t) (CARD_CACHE_PAGE_SIZE / slot_width * slot_width) * (CARD_CACHE_PAGE_SIZE / slot_height * slot_height) * 4;
+        if (cache.bytes_used + bytes <= cache.byte_budget) {
+            entry.page = load_page(cache, slot_width, slot_height);
+            entry.slot = cache.pages[entry.page].free_slots.back();
+            cache.pages[entry.page].free_slots.pop_back();
+            return true;
+        }
+        if (!evict_one(cache)) return false;
+    }
+}
+
+static bool render_card_face(CardTextureCache& cache, CachedCard& entry, Card& card, float scale) {
+    float width = card.body_rect.width * scale;
+    float height = card.body_rect.height * scale;
+    bool fits = entry.page != -1 && cache.pages[entry.page].slot_width == round_up_to_slot(width) &&
+        cache.pages[entry.page].slot_height == round_up_to_slot(height);
+    if (!fits) {
+        release_slot(cache, entry);
+        if (!allocate_slot(cache, entry, width, height)) return false;
+    }
+
+    auto &page = cache.pages[entry.page];
+    float slot_x = (entry.slot % page.columns) * page.slot_width;
+    float slot_y = (entry.slot / page.columns) * page.slot_height;
+    // Render textures come out upside down.
+    entry.source = {slot_x, page.texture.texture.height - slot_y - height, width, -height};
+
+    Camera2D face_camera = {0};
+    face_camera.offset = {slot_x, slot_y};
+    face_camera.target = {card.body_rect.x, card.body_rect.y};
+    face_camera.zoom = scale;
+
+    // The face has to go into the page, not into the batch being recorded for the screen.
+    bool recording = sprite_batch.recording;
+    sprite_batch.recording = false;
+    BeginTextureMode(page.texture);
+    // Wipe whatever the last card in this slot left behind. Subtracting a color from itself is the only way
+    // to write transparent pixels without clearing the whole page.
+    BeginBlendMode(BLEND_SUBTRACT_COLORS);
+    DrawRectangle(slot_x, slot_y, page.slot_width, page.slot_height, BLANK);
+    EndBlendMode();
+    BeginMode2D(face_camera);
+    draw_card_face(card);
+    EndMode2D();
+    EndTextureMode();
+    sprite_batch.recording = recording;
+    return true;
+}
+
+CardTextureCache init_card_texture_cache(size_t byte_budget) {
+    CardTextureCache cache;
+    cache.entries = std::unordered_map<std::string, CachedCard>();
+    cache.lru = std::list<std::string>();
+    cache.pages = std::vector<CardCachePage>();
+    cache.bytes_used = 0;
+    cache.byte_budget = byte_budget;
+    cache.frame = 0;
+    cache.renders_this_frame = 0;
+    cache.hits_this_frame = 0;
+    return cache;
+}
+
+void clear_card_texture_cache(CardTextureCache& cache) {
+    for (auto &page: cache.pages) {
+        if (page.loaded) UnloadRenderTexture(page.texture);
+    }
+    cache.pages.clear();
+    cache.entries.clear();
+    cache.lru.clear();
+    cache.bytes_used = 0;
+}
+
+void begin_card_texture_cache_frame(CardTextureCache& cache) {
+    cache.frame += 1;
+    cache.renders_this_frame = 0;
+    cache.hits_this_frame = 0;
+}
+
+// Returns the cached image to draw for `card`, or NULL if the card should be drawn directly this frame.
+// Cards being interacted with are never cached. A card is only (re)rendered once it has looked the same
+// for two frames in a row, so cards in the middle of a resize or zoom tween don't re-render every frame.
+// Must be called before drawing starts, outside any texture, shader or 2D mode.
+CachedCard* prepare_cached_card(CardTextureCache& cache, Card& card, Camera2D camera) {
+    if (card.hover || card.grabbed || card.selected || card.draw_resize || card.in_drawer || card.parent != NO_CARD) return NULL;
+    float scale = cache_scale(camera);
+
+    auto found = cache.entries.find(card.id);
+    if (found == cache.entries.end()) {
+        cache.lru.push_front(card.id);
+        CachedCard entry;
+        entry.key = make_face_key(card, scale);
+        entry.last_key = entry.key;
+        entry.page = -1;
+        entry.slot = 0;
+        entry.source = {0};
+        entry.last_used_frame = cache.frame;
+        entry.lru_position = cache.lru.begin();
+        cache.entries.emplace(card.id, entry);
+        while (cache.entries.size() > CARD_CACHE_MAX_ENTRIES && evict_one(cache));
+        return NULL;
+    }
+
+    auto &entry = found->second;
+    entry.last_used_frame = cache.frame;
+    cache.lru.splice(cache.lru.begin(), cache.lru, entry.lru_position);
+    if (entry.page != -1 && face_key_matches(entry.key, card, scale)) {
+        cache.hits_this_frame += 1;
+        return &entry;
+    }
+    if (!face_key_matches(entry.last_key, card, scale)) {
+        entry.last_key = make_face_key(card, scale);
+        return NULL;
+    }
+    if (cache.renders_this_frame >= CARD_CACHE_RENDERS_PER_FRAME) return NULL;
+
+    if (!render_card_face(cache, entry, card, scale)) return NULL;
+    entry.key = entry.last_key;
+    cache.renders_this_frame += 1;
+    cache.hits_this_frame += 1;
+    return &entry;
+}
+
+void draw_cached_card(const CardTextureCache& cache, const CachedCard& entry, const Card& card) {
+    set_sprite_layer(sprite_batch, SPRITE_LAYER_UNDER);
+    // Blending into the texture leaves antialiased glyph edges slightly see-through, so back the image with the card color.
+    draw_sprite_rect((Rectangle) {card.body_rect.x + 3, card.body_rect.y + 3, card.body_rect.width - 3, card.body_rect.height - 3}, card.tone == LIGHT ? CARDWHITE : CARDBLACK);
+    draw_sprite(cache.pages[entry.page].texture.texture, entry.source, card.body_rect);
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "common.hpp"
+#include "card.hpp"
+#include <list>
+#include <unordered_map>
+
+// Default memory budget for cached card textures (RGBA8, so 4 bytes a pixel).
+#define CARD_CACHE_BUDGET (64 * 1024 * 1024)
+// How many cards may be re-rendered into the cache in a single frame. The rest draw directly until their turn.
+#define CARD_CACHE_RENDERS_PER_FRAME 8
+// Cap on tracked cards, so ids of deleted cards don't pile up between evictions.
+#define CARD_CACHE_MAX_ENTRIES 8192
+// Side of one atlas page in pixels. Cards bigger than this at the current zoom are drawn directly.
+#define CARD_CACHE_PAGE_SIZE 1024
+// Slot sizes are rounded up to this, so cards of about the same size share a page.
+#define CARD_CACHE_SLOT_STEP 64
+
+// Everything the cached image of a card depends on. The text is only known by its Card::content_revision.
+struct CardFaceKey {
+    unsigned int content_revision;
+    float width;
+    float height;
+    float font_size;
+    float scale;
+    CardType type;
+    Tone tone;
+    bool is_beginning;
+    bool is_end;
+    bool has_cards_under;
+};
+
+// One render texture cut into equal slots, each holding the image of one card.
+struct CardCachePage {
+    RenderTexture2D texture;
+    bool loaded;
+    int slot_width;
+    int slot_height;
+    int columns;
+    int rows;
+    std::vector<int> free_slots;
+};
+
+struct CachedCard {
+    CardFaceKey key; // What the slot was rendered from
+    CardFaceKey last_key; // What the card looked like the last time it was drawn
+    int page; // -1 until the card has been rendered
+    int slot;
+    Rectangle source; // Where the image is on the page, already flipped
+    unsigned int last_used_frame;
+    std::list<std::string>::iterator lru_position;
+};
+
+// Offscreen images of idle cards, keyed by card id, packed into a few shared atlas pages. Drawing an idle card is
+// one textured quad, and every cached card on the same page draws in the same batch.
+// Least recently drawn cards are evicted to keep the pages under the budget. Cards drawn this frame are never
+// evicted for another card; when every slot is in use the extra cards are just drawn directly.
+struct CardTextureCache {
+    std::unordered_map<std::string, CachedCard> entries;
+    std::list<std::string> lru; // Most recently drawn at the front
+    std::vector<CardCachePage> pages;
+    size_t bytes_used;
+    size_t byte_budget;
+    unsigned int frame;
+    int renders_this_frame;
+    int hits_this_frame;
+};
+
+CardTextureCache init_card_texture_cache(size_t byte_budget = CARD_CACHE_BUDGET);
+void clear_card_texture_cache(CardTextureCache& cache);
+void begin_card_texture_cache_frame(CardTextureCache& cache);
+CachedCard* prepare_cached_card(CardTextureCache& cache, Card& card, Camera2D camera);
+void draw_cached_card(const CardTextureCache& cache, const CachedCard& entry, const Card& card);
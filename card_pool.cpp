@@ -1,49 +1,103 @@
 #include "card_pool.hpp"
 #include "card.hpp"
-#include <cstdlib>
-#include <cstring>
+#include <new>
 
-Card* begin(CardPool& pool) {
-    return pool.memory;
+static CardPoolSlot& pool_slot(const CardPool& pool, int index) {
+    return pool.chunks[index / CARD_POOL_CHUNK_SIZE][index % CARD_POOL_CHUNK_SIZE];
 }
 
-Card* end(CardPool& pool) {
-    return pool.memory + pool.max_elements;
+// Adds a chunk of free slots. They go on the front of the free list lowest index first.
+static void grow_pool(CardPool& pool) {
+    auto chunk = new CardPoolSlot[CARD_POOL_CHUNK_SIZE];
+    int first_index = pool.capacity;
+    for (int i = 0; i < CARD_POOL_CHUNK_SIZE; i++) {
+        chunk[i].next_free = i + 1 < CARD_POOL_CHUNK_SIZE ? first_index + i + 1 : pool.first_free;
+    }
+    pool.chunks.push_back(chunk);
+    pool.first_free = first_index;
+    pool.capacity += CARD_POOL_CHUNK_SIZE;
 }
 
 CardPool init_pool(int num_cards) {
     CardPool pool;
-    pool.memory = (Card*) malloc(sizeof(Card) * num_cards);
-    memset(pool.memory, 0xAB, sizeof(Card) * num_cards);
-    pool.current_element = pool.memory;
-    pool.max_elements = num_cards;
+    pool.chunks = std::vector<CardPoolSlot*>();
+    pool.first_free = -1;
+    pool.capacity = 0;
     pool.active_cards = 0;
+    pool.added = std::vector<int>();
+    while (pool.capacity < num_cards) grow_pool(pool);
     return pool;
 }
 
-bool add_card(CardPool& pool, const Card card) {
-    pool.active_cards += 1;
-    pool.current_element = pool.memory;
-    while (*((unsigned char*) pool.current_element) != 0xAB) {
-        pool.current_element++;
-    }
-    memcpy(pool.current_element, &card, sizeof(Card));
-    return true;
-}
-
-void cull(CardPool& pool) {
-    int current = 0;
-    Card *current_card = pool.memory;
-    while (current < pool.max_elements) {
-        if ((*((unsigned char*) current_card) != 0xAB) && (current_card->deleted)) {
-            memset(current_card, 0xAB, sizeof(Card));
-            pool.active_cards -= 1;
-        }
-        current_card++;
-        current += 1;
+// Destroys every card but keeps the chunks for reuse.
+void clear_pool(CardPool& pool) {
+    pool.first_free = -1;
+    for (int index = pool.capacity - 1; index >= 0; index--) {
+        auto &slot = pool_slot(pool, index);
+        if (slot.live) slot.card.~Card();
+        slot.live = false;
+        slot.next_free = pool.first_free;
+        pool.first_free = index;
     }
+    pool.active_cards = 0;
+    pool.added.clear();
+}
+
+void free_pool(CardPool& pool) {
+    clear_pool(pool);
+    for (auto chunk: pool.chunks) delete[] chunk;
+    pool.chunks.clear();
+    pool.first_free = -1;
+    pool.capacity = 0;
+}
+
+// Copies `card` into a free slot, growing the pool if there is none. The copy isn't on the board until
+// update_cards has seen it.
+Card* add_card(CardPool& pool, const Card& card) {
+    if (pool.first_free == -1) grow_pool(pool);
+    int index = pool.first_free;
+    auto &slot = pool_slot(pool, index);
+    pool.first_free = slot.next_free;
+    new (&slot.card) Card(card);
+    slot.live = true;
+    slot.card.slot = -1;
+    pool.active_cards += 1;
+    pool.added.push_back(index);
+    return &slot.card;
+}
+
+void remove_card(CardPool& pool, int index) {
+    auto &slot = pool_slot(pool, index);
+    if (!slot.live) return;
+    slot.card.~Card();
+    slot.live = false;
+    slot.next_free = pool.first_free;
+    pool.first_free = index;
+    pool.active_cards -= 1;
+}
+
+bool slot_is_live(const CardPool& pool, int index) {
+    return index >= 0 && index < pool.capacity && pool_slot(pool, index).live;
+}
+
+// First live slot at or after `index`, or the pool's capacity if there is none.
+int next_live_slot(const CardPool& pool, int index) {
+    while (index < pool.capacity && !pool_slot(pool, index).live) index++;
+    return index;
+}
+
+CardPoolIterator begin(CardPool& pool) {
+    return {&pool, next_live_slot(pool, 0)};
+}
+
+CardPoolIterator end(CardPool& pool) {
+    return {&pool, pool.capacity};
+}
+
+ConstCardPoolIterator begin(const CardPool& pool) {
+    return {&pool, next_live_slot(pool, 0)};
 }
 
-void free_pool(CardPool &pool) {
-    free(pool.memory);
+ConstCardPoolIterator end(const CardPool& pool) {
+    return {&pool, pool.capacity};
 }
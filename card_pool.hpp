@@ -1,16 +1,79 @@
 #pragma once
 #include "card.hpp"
+#include <iterator>
 
+// Slots are allocated this many at a time. Chunks are never moved or freed while the pool is alive.
+#define CARD_POOL_CHUNK_SIZE 256
+
+// A free slot doesn't hold a card, so its storage holds the index of the next free slot instead.
+struct CardPoolSlot {
+    union {
+        Card card;
+        int next_free; // -1 at the end of the free list
+    };
+    bool live;
+
+    CardPoolSlot() : next_free(-1), live(false) {}
+    ~CardPoolSlot() {}
+};
+
+// Object pool the board's cards live in. Cards are never moved once added, so their addresses and slot indices
+// stay valid until they are removed, however many cards come and go around them.
 struct CardPool {
-    Card *memory;
-    Card *current_element;
-    int max_elements;
+    std::vector<CardPoolSlot*> chunks;
+    int first_free; // -1 when every slot is taken
+    int capacity;
     int active_cards;
+    std::vector<int> added; // Slots filled since update_cards last looked
+};
+
+CardPool init_pool(int num_cards = CARD_POOL_CHUNK_SIZE);
+void free_pool(CardPool& pool);
+void clear_pool(CardPool& pool);
+Card* add_card(CardPool& pool, const Card& card);
+void remove_card(CardPool& pool, int index);
+bool slot_is_live(const CardPool& pool, int index);
+int next_live_slot(const CardPool& pool, int index);
+
+inline Card& pool_card(CardPool& pool, int index) {
+    return pool.chunks[index / CARD_POOL_CHUNK_SIZE][index % CARD_POOL_CHUNK_SIZE].card;
+}
+
+inline const Card& pool_card(const CardPool& pool, int index) {
+    return pool.chunks[index / CARD_POOL_CHUNK_SIZE][index % CARD_POOL_CHUNK_SIZE].card;
+}
+
+// Walks the live cards in slot order, skipping free slots.
+template <typename Pool, typename T>
+struct CardPoolIteratorBase {
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Card;
+    using difference_type = std::ptrdiff_t;
+    using pointer = T*;
+    using reference = T&;
+
+    Pool *pool;
+    int index;
+
+    T& operator*() const { return pool_card(*pool, index); }
+    T* operator->() const { return &pool_card(*pool, index); }
+    CardPoolIteratorBase& operator++() {
+        index = next_live_slot(*pool, index + 1);
+        return *this;
+    }
+    CardPoolIteratorBase operator++(int) {
+        auto before = *this;
+        ++(*this);
+        return before;
+    }
+    bool operator==(const CardPoolIteratorBase& other) const { return index == other.index; }
+    bool operator!=(const CardPoolIteratorBase& other) const { return index != other.index; }
 };
 
-Card* begin(CardPool& pool);
-Card* end(CardPool& pool);
-CardPool init_pool(int num_cards = 256);
-bool add_card(CardPool& pool, const Card card);
-void free_pool(CardPool &pool);
-void cull(CardPool& pool);
+typedef CardPoolIteratorBase<CardPool, Card> CardPoolIterator;
+typedef CardPoolIteratorBase<const CardPool, const Card> ConstCardPoolIterator;
+
+CardPoolIterator begin(CardPool& pool);
+CardPoolIterator end(CardPool& pool);
+ConstCardPoolIterator begin(const CardPool& pool);
+ConstCardPoolIterator end(const CardPool& pool);
@@ -1,4 +1,5 @@
 #include "common.hpp"
+#include "sprite_batch.hpp"
 
 template<typename T>
 T clamp(T value, T lower, T upper) {
@@ -124,6 +125,13 @@ Vector2 get_world_mouse_position(Camera2D camera) {
     return position;
 }
 
+// World space area the camera shows on screen. Assumes the camera isn't rotated.
+Rectangle get_camera_view_rect(Camera2D camera) {
+    auto top_left = GetScreenToWorld2D((Vector2) {0, 0}, camera);
+    auto bottom_right = GetScreenToWorld2D((Vector2) {(float) GetScreenWidth(), (float) GetScreenHeight()}, camera);
+    return {top_left.x, top_left.y, bottom_right.x - top_left.x, bottom_right.y - top_left.y};
+}
+
 Button init_button(Rectangle button_rect, std::string button_text, Texture texture) {
     Button button;
     button.rect = button_rect;
@@ -165,7 +173,7 @@ void draw_pixel_rect(Rectangle rec, float border_size,  Color fill, Color border
 }
 
 void draw_texture_rect_scaled(Texture2D texture, Rectangle texture_source, Vector2 where, Vector2 stretch, int scale) {
-    DrawTexturePro(spritesheet, texture_source, {where.x, where.y, texture_source.width * scale + stretch.x * scale, texture_source.height * scale + stretch.y * scale}, {0, 0}, 0.0, WHITE);
+    draw_sprite(spritesheet, texture_source, {where.x, where.y, texture_source.width * scale + stretch.x * scale, texture_source.height * scale + stretch.y * scale});
 }
 
 void draw_text_rec_justified(Font font, const char *text, Rectangle rec, float fontSize, float spacing, bool wordWrap, Color tint) {
@@ -174,9 +182,58 @@ void draw_text_rec_justified(Font font, const char *text, Rectangle rec, float f
 
 // Draw text using font inside rectangle limits with support for text selection
 /// EDITED: Justifies text
+/// Lays the text out from scratch every call. Anything drawn every frame should keep a TextLayout around instead.
 void draw_text_rec_ex_justified(Font font, const char *text, Rectangle rec, float fontSize, float spacing, bool wordWrap, Color tint, int selectStart, int selectLength, Color selectTint, Color selectBackTint) {
+    static TextLayout layout = init_text_layout();
+    layout_text_rec(layout, font, text, 0, fontSize, spacing, rec.width, wordWrap, true);
+    draw_text_layout_selection(layout, font, rec, selectStart, selectLength, selectBackTint);
+    draw_text_layout(layout, font, rec, tint, selectStart, selectLength, selectTint);
+}
+
+TextLayout init_text_layout() {
+    TextLayout layout;
+    layout.revision = 0;
+    layout.font_id = 0;
+    layout.font_size = 0;
+    layout.spacing = 0;
+    layout.width = -1;
+    layout.word_wrap = false;
+    layout.centered = false;
+    layout.glyphs = std::vector<TextLayoutGlyph>();
+    layout.newlines = std::vector<int>();
+    return layout;
+}
+
+// `revision` has to change whenever the text does, like Card::content_revision. Revision 0 never matches.
+bool text_layout_matches(const TextLayout& layout, Font font, unsigned int revision, float fontSize, float spacing, float width, bool wordWrap, bool centered) {
+    return revision != 0 && layout.revision == revision && layout.font_id == font.texture.id && layout.font_size == fontSize &&
+        layout.spacing == spacing && layout.width == width && layout.word_wrap == wordWrap && layout.centered == centered;
+}
+
+// Works out where each glyph of `text` goes inside a rectangle `width` wide, wrapping words and optionally centering each line.
+// Lines past the bottom of the rectangle are laid out too; draw_text_layout stops at whatever height it's given.
+void layout_text_rec(TextLayout& layout, Font font, const std::string& text_string, unsigned int revision, float fontSize, float spacing, float width, bool wordWrap, bool centered) {
+    layout.revision = revision;
+    layout.font_id = font.texture.id;
+    layout.font_size = fontSize;
+    layout.spacing = spacing;
+    layout.width = width;
+    layout.word_wrap = wordWrap;
+    layout.centered = centered;
+    layout.glyphs.clear();
+    layout.newlines.clear();
+
+    const char *text = text_string.c_str();
     int length = TextLength(text);  // Total length in bytes of the text, scanned by codepoints in loop
 
+    for (int i = 0, k = 0; i < length; k++) {
+        int codepointByteCount = 0;
+        int codepoint = GetNextCodepoint(&text[i], &codepointByteCount);
+        if (codepoint == 0x3f) codepointByteCount = 1;
+        if (codepoint == '\n') layout.newlines.push_back(k);
+        i += codepointByteCount;
+    }
+
     int textOffsetY = 0;            // Offset between lines (on line break '\n')
     float textOffsetX = 0.0f;       // Offset X to next character to draw
 
@@ -189,6 +246,7 @@ void draw_text_rec_ex_justified(Font font, const char *text, Rectangle rec, floa
     int startLine = -1;         // Index where to begin drawing (where a line begins)
     int endLine = -1;           // Index where to stop drawing (where a line ends)
     int lastk = -1;             // Holds last value of the character position
+    int selectOffset = 0;       // How far character positions have drifted from selection positions
 
     int textToDrawWidth = 0;
 
@@ -226,7 +284,7 @@ void draw_text_rec_ex_justified(Font font, const char *text, Rectangle rec, floa
                 endLine = i;
             }
 
-            if ((textOffsetX + glyphWidth + 1) >= rec.width)
+            if ((textOffsetX + glyphWidth + 1) >= width)
             {
                 endLine = (endLine < 1)? i : endLine;
                 if (i == endLine) endLine -= codepointByteCount;
@@ -256,19 +314,21 @@ void draw_text_rec_ex_justified(Font font, const char *text, Rectangle rec, floa
                 k = tmp;
 
                 // Get width of text we're going to render.
-                for (int justify_index = i; justify_index < endLine; justify_index++) {
-                    int _codepointByteCount = 0;
-                    int _codepoint = GetNextCodepoint(&text[justify_index], &_codepointByteCount);
-                    int _index = GetGlyphIndex(font, _codepoint);
-
-                    int _glyphWidth = 0;
-                    if (_codepoint != '\n')
-                    {
-                        _glyphWidth = (font.chars[_index].advanceX == 0)?
-                            (int)(font.recs[_index].width*scaleFactor + spacing):
-                            (int)(font.chars[_index].advanceX*scaleFactor + spacing);
+                if (centered) {
+                    for (int justify_index = i; justify_index < endLine; justify_index++) {
+                        int _codepointByteCount = 0;
+                        int _codepoint = GetNextCodepoint(&text[justify_index], &_codepointByteCount);
+                        int _index = GetGlyphIndex(font, _codepoint);
+
+                        int _glyphWidth = 0;
+                        if (_codepoint != '\n')
+                        {
+                            _glyphWidth = (font.chars[_index].advanceX == 0)?
+                                (int)(font.recs[_index].width*scaleFactor + spacing):
+                                (int)(font.chars[_index].advanceX*scaleFactor + spacing);
+                        }
+                        textToDrawWidth += _glyphWidth;
                     }
-                    textToDrawWidth += _glyphWidth;
                 }
             }
         }
@@ -284,28 +344,14 @@ void draw_text_rec_ex_justified(Font font, const char *text, Rectangle rec, floa
             }
             else
             {
-                if (!wordWrap && ((textOffsetX + glyphWidth + 1) >= rec.width))
+                if (!wordWrap && ((textOffsetX + glyphWidth + 1) >= width))
                 {
                     textOffsetY += (int)((font.baseSize + font.baseSize/2)*scaleFactor);
                     textOffsetX = 0;
                 }
 
-                // When text overflows rectangle height limit, just stop drawing
-                if ((textOffsetY + (int)(font.baseSize*scaleFactor)) > rec.height) break;
-
-                // Draw selection background
-                bool isGlyphSelected = false;
-                if ((selectStart >= 0) && (k >= selectStart) && (k < (selectStart + selectLength)))
-                {
-                    DrawRectangleRec((Rectangle){ rec.x + textOffsetX - 1, rec.y + textOffsetY, (float)glyphWidth, (float)font.baseSize*scaleFactor }, selectBackTint);
-                    isGlyphSelected = true;
-                }
-
-                // Draw current character glyph
-                if ((codepoint != ' ') && (codepoint != '\t'))
-                {
-                    DrawTextCodepoint(font, codepoint, (Vector2){ rec.x + textOffsetX + ((rec.width - textToDrawWidth) / 2.0), rec.y + textOffsetY }, fontSize, isGlyphSelected? selectTint : tint);
-                }
+                float lineOffsetX = centered ? (width - textToDrawWidth) / 2.0 : 0.0;
+                layout.glyphs.push_back({codepoint, k - selectOffset, {textOffsetX + lineOffsetX, (float) textOffsetY}, (float) glyphWidth});
             }
 
             if (wordWrap && (i == endLine))
@@ -315,7 +361,7 @@ void draw_text_rec_ex_justified(Font font, const char *text, Rectangle rec, floa
                 startLine = endLine;
                 endLine = -1;
                 glyphWidth = 0;
-                selectStart += lastk - k;
+                selectOffset += lastk - k;
                 k = lastk;
 
                 state = !state;
@@ -325,6 +371,70 @@ void draw_text_rec_ex_justified(Font font, const char *text, Rectangle rec, floa
     }
 }
 
+// Replays a layout inside `rec`. Glyphs that would go past the bottom of `rec` are left out. Selected glyphs are
+// drawn in `selectTint`; the background behind them is drawn separately, by draw_text_layout_selection.
+void draw_text_layout(const TextLayout& layout, Font font, Rectangle rec, Color tint, int selectStart, int selectLength, Color selectTint) {
+    float scaleFactor = layout.font_size/font.baseSize;
+    float glyphHeight = (float) font.baseSize*scaleFactor;
+    for (const auto& glyph: layout.glyphs) {
+        // When text overflows rectangle height limit, just stop drawing
+        if ((glyph.position.y + (int) glyphHeight) > rec.height) break;
+
+        bool isGlyphSelected = (selectStart >= 0) && (glyph.index >= selectStart) && (glyph.index < (selectStart + selectLength));
+
+        // Draw current character glyph
+        if ((glyph.codepoint != ' ') && (glyph.codepoint != '\t'))
+        {
+            draw_sprite_codepoint(font, glyph.codepoint, (Vector2){ rec.x + glyph.position.x, rec.y + glyph.position.y }, layout.font_size, isGlyphSelected? selectTint : tint);
+        }
+    }
+}
+
+// The selection background behind the glyphs draw_text_layout draws selected. It's drawn with the shapes texture
+// and the glyphs aren't, so it's kept apart to let the batch draw all of it before any of the text.
+void draw_text_layout_selection(const TextLayout& layout, Font font, Rectangle rec, int selectStart, int selectLength, Color selectBackTint) {
+    if (selectStart < 0 || selectLength <= 0) return;
+    float scaleFactor = layout.font_size/font.baseSize;
+    float glyphHeight = (float) font.baseSize*scaleFactor;
+    for (const auto& glyph: layout.glyphs) {
+        if ((glyph.position.y + (int) glyphHeight) > rec.height) break;
+        if ((glyph.index >= selectStart) && (glyph.index < (selectStart + selectLength)))
+        {
+            draw_sprite_rect((Rectangle){ rec.x + glyph.position.x - 1, rec.y + glyph.position.y, glyph.width, glyphHeight }, selectBackTint);
+        }
+    }
+}
+
+// Where a caret in front of the codepoint numbered `index` goes, relative to where the layout is drawn. Newlines
+// don't get a glyph, so a caret at the end of a line or on an empty one is placed from the glyphs around it.
+Vector2 text_layout_caret(const TextLayout& layout, Font font, int index) {
+    float lineHeight = (int)((font.baseSize + font.baseSize/2)*(layout.font_size/font.baseSize));
+    const TextLayoutGlyph *before = NULL;
+    const TextLayoutGlyph *at = NULL;
+    for (const auto& glyph: layout.glyphs) {
+        if (glyph.index >= index) {
+            at = &glyph;
+            break;
+        }
+        before = &glyph;
+    }
+
+    // Lines started by a newline between the glyph before the caret and the caret.
+    int from = before ? before->index + 1 : 0;
+    int newlines = std::lower_bound(layout.newlines.begin(), layout.newlines.end(), index) -
+        std::lower_bound(layout.newlines.begin(), layout.newlines.end(), from);
+
+    float lineStartX = layout.centered ? layout.width / 2 : 0;
+    if (newlines == 0) {
+        if (at && at->index == index && (!before || at->position.y == before->position.y)) return at->position;
+        if (before) return {before->position.x + before->width, before->position.y};
+        return {lineStartX, 0};
+    }
+    float y = (before ? before->position.y : 0) + newlines*lineHeight;
+    if (at && at->index == index && at->position.y == y) return at->position;
+    return {lineStartX, y};
+}
+
 void set_darkness_shader_amount(float amount) {
     int darken_loc = GetShaderLocation(darken_shader, "darkness_mod");
     float value = amount;
@@ -102,6 +102,7 @@ inline int get_font_size(Font *font) {
 }
 
 Vector2 get_world_mouse_position(Camera2D camera);
+Rectangle get_camera_view_rect(Camera2D camera);
 
 #define GRIDSIZE 16
 
@@ -128,6 +129,36 @@ void draw_pixel_rect(Rectangle rec, float border_size = 3.0, Color fill = WHITE,
 
 void draw_texture_rect_scaled(Texture2D texture, Rectangle texture_source, Vector2 where, Vector2 stretch = {0}, int scale = 3);
 
+// Where every glyph of a wrapped block of text goes, relative to the top left of its rectangle.
+struct TextLayoutGlyph {
+    int codepoint;
+    int index; // Character index used for selection
+    Vector2 position;
+    float width;
+};
+
+struct TextLayout {
+    // What the layout was built from. If any of these change the layout needs rebuilding. The text itself is
+    // only known by the revision the caller gave it, so telling a layout is stale doesn't cost a pass over the text.
+    unsigned int revision;
+    unsigned int font_id;
+    float font_size;
+    float spacing;
+    float width;
+    bool word_wrap;
+    bool centered;
+
+    std::vector<TextLayoutGlyph> glyphs;
+    std::vector<int> newlines; // Character index of every line break in the text, which don't get a glyph
+};
+
+TextLayout init_text_layout();
+bool text_layout_matches(const TextLayout& layout, Font font, unsigned int revision, float fontSize, float spacing, float width, bool wordWrap, bool centered);
+void layout_text_rec(TextLayout& layout, Font font, const std::string& text, unsigned int revision, float fontSize, float spacing, float width, bool wordWrap, bool centered);
+void draw_text_layout(const TextLayout& layout, Font font, Rectangle rec, Color tint, int selectStart = 0, int selectLength = 0, Color selectTint = WHITE);
+void draw_text_layout_selection(const TextLayout& layout, Font font, Rectangle rec, int selectStart, int selectLength, Color selectBackTint);
+Vector2 text_layout_caret(const TextLayout& layout, Font font, int index);
+
 void draw_text_rec_justified(Font font, const char *text, Rectangle rec, float fontSize, float spacing, bool wordWrap, Color tint);
 void draw_text_rec_ex_justified(Font font, const char *text, Rectangle rec, float fontSize, float spacing, bool wordWrap, Color tint, int selectStart, int selectLength, Color selectTint, Color selectBackTint);
 
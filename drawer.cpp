@@ -1,26 +1,37 @@
 #include "drawer.hpp"
 #include "card.hpp"
+#include "serialization.hpp"
 
-Drawer init_drawer(std::vector<Card>* cards) {
+Drawer init_drawer() {
     Drawer drawer;
     drawer.open = false;
     drawer.body_rect = {0,0, 300, 100000};
-    drawer.cards = cards;
+    drawer.owner = NO_CARD;
     return drawer;
 }
 
 void update_drawer(Drawer& drawer) {}
 
-void draw_drawer(const Drawer& drawer, Camera2D camera) {
+// NULL once the owning card is gone.
+std::vector<Card>* get_drawer_cards(const Drawer& drawer, CardPool& cards) {
+    Card *owner = get_card(cards, drawer.owner);
+    if (owner == NULL) return NULL;
+    load_lazy_card(*owner);
+    return &owner->cards_under;
+}
+
+void draw_drawer(const Drawer& drawer, CardPool& cards, Camera2D camera) {
     DrawRectangleRec(drawer.body_rect, {249, 232, 202, 255});
+    auto drawer_cards = get_drawer_cards(drawer, cards);
+    if (drawer_cards == NULL) return;
     int card_index = 0;
-    for (auto &card: *drawer.cards) {
+    for (auto &card: *drawer_cards) {
         Defer {card_index += 1;};
         card.body_rect.x = 0;
         card.body_rect.y = (GRIDSIZE * 13) * card_index;
         card.body_rect.width = GRIDSIZE * 17;
         card.body_rect.height = GRIDSIZE * 13;
-        card.parent = NULL;
+        card.parent = NO_CARD;
         card.in_drawer = true;
         card.move_up_button.rect = {card.body_rect.x + card.body_rect.width - 66, card.body_rect.y + card.body_rect.height - 36 * 2, 27, 30};
         card.move_down_button.rect = {card.body_rect.x + card.body_rect.width - 66, card.body_rect.y + card.body_rect.height - 36, 27, 30};
@@ -5,9 +5,10 @@
 struct Drawer {
     bool open;
     Rectangle body_rect;
-    std::vector<Card>* cards;
+    CardHandle owner; // Card whose cards_under are shown
 };
 
-Drawer init_drawer(std::vector<Card>* cards = NULL);
+Drawer init_drawer();
 void update_drawer(Drawer& drawer);
-void draw_drawer(const Drawer& drawer, Camera2D camera);
+std::vector<Card>* get_drawer_cards(const Drawer& drawer, CardPool& cards);
+void draw_drawer(const Drawer& drawer, CardPool& cards, Camera2D camera);
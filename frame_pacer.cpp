@@ -0,0 +1,79 @@
+#include "frame_pacer.hpp"
+#include "common.hpp"
+
+FramePacer init_frame_pacer() {
+    FramePacer pacer;
+    pacer.frame = {0};
+    pacer.has_frame = false;
+    pacer.target_fps = ACTIVE_FPS;
+    pacer.last_mouse_position = GetMousePosition();
+    SetTargetFPS(pacer.target_fps);
+    return pacer;
+}
+
+void unload_frame_pacer(FramePacer& pacer) {
+    if (pacer.has_frame) UnloadRenderTexture(pacer.frame);
+    pacer.has_frame = false;
+}
+
+// Whether the player did anything since the last frame. Doesn't consume any input, so call it before the
+// update functions.
+bool input_happened(FramePacer& pacer) {
+    bool happened = false;
+    auto mouse_position = GetMousePosition();
+    if (mouse_position.x != pacer.last_mouse_position.x || mouse_position.y != pacer.last_mouse_position.y) happened = true;
+    pacer.last_mouse_position = mouse_position;
+    if (GetMouseWheelMove() != 0) happened = true;
+    for (int button = MOUSE_LEFT_BUTTON; button <= MOUSE_MIDDLE_BUTTON && !happened; button++) {
+        if (IsMouseButtonDown(button) || IsMouseButtonReleased(button)) happened = true;
+    }
+    for (int key = KEY_SPACE; key <= KEY_KB_MENU && !happened; key++) {
+        if (IsKeyDown(key) || IsKeyReleased(key)) happened = true;
+    }
+    return happened;
+}
+
+void set_frame_pacing(FramePacer& pacer, bool idle, bool focused) {
+    int target_fps = idle ? (focused ? IDLE_FPS : UNFOCUSED_IDLE_FPS) : (focused ? ACTIVE_FPS : UNFOCUSED_FPS);
+    if (target_fps == pacer.target_fps) return;
+    SetTargetFPS(target_fps);
+    pacer.target_fps = target_fps;
+}
+
+// False if the kept frame can be shown again as is. Resizing the window always needs a new frame.
+bool frame_needs_redraw(FramePacer& pacer, bool dirty) {
+    if (pacer.has_frame && (pacer.frame.texture.width != GetScreenWidth() || pacer.frame.texture.height != GetScreenHeight())) {
+        UnloadRenderTexture(pacer.frame);
+        pacer.has_frame = false;
+    }
+    if (!pacer.has_frame) {
+        pacer.frame = LoadRenderTexture(GetScreenWidth(), GetScreenHeight());
+        pacer.has_frame = true;
+        return true;
+    }
+    return dirty;
+}
+
+static void present_frame(FramePacer& pacer) {
+    BeginDrawing();
+    ClearBackground(RAYWHITE);
+    // Render textures come out upside down.
+    DrawTextureRec(pacer.frame.texture, (Rectangle) {0, 0, (float) pacer.frame.texture.width, (float) -pacer.frame.texture.height}, (Vector2) {0, 0}, WHITE);
+    EndDrawing();
+}
+
+// Everything drawn until end_frame goes into the kept frame. Render textures of their own (like the card cache)
+// have to be drawn to before this, since ending their texture mode would switch back to the screen.
+void begin_frame(FramePacer& pacer) {
+    BeginTextureMode(pacer.frame);
+}
+
+void end_frame(FramePacer& pacer) {
+    EndTextureMode();
+    present_frame(pacer);
+}
+
+// A frame where nothing changed. Shows the kept frame again instead of drawing the board.
+void idle_frame(FramePacer& pacer) {
+    present_frame(pacer);
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include "common.hpp"
+
+#define ACTIVE_FPS 60
+#define UNFOCUSED_FPS 10
+// While nothing changes the last frame is shown again at this rate. Input is still only polled once a frame,
+// so this also sets how long the first input after a quiet spell can take to show up.
+#define IDLE_FPS 20
+#define UNFOCUSED_IDLE_FPS 4
+
+// Keeps the last drawn frame in a render texture so the main loop can skip drawing while nothing changes.
+// raylib only polls input in EndDrawing, so idle frames still have to begin and end drawing, at a lower frame
+// rate. Each of them blits the kept frame, since what's left in the window's back buffer after a swap is undefined.
+struct FramePacer {
+    RenderTexture2D frame;
+    bool has_frame;
+    int target_fps;
+    Vector2 last_mouse_position;
+};
+
+FramePacer init_frame_pacer();
+void unload_frame_pacer(FramePacer& pacer);
+bool input_happened(FramePacer& pacer);
+void set_frame_pacing(FramePacer& pacer, bool idle, bool focused);
+bool frame_needs_redraw(FramePacer& pacer, bool dirty);
+void begin_frame(FramePacer& pacer);
+void end_frame(FramePacer& pacer);
+void idle_frame(FramePacer& pacer);
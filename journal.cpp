@@ -0,0 +1,432 @@
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include "json.hpp"
+#include "common.hpp"
+#include "card.hpp"
+#include "card_pool.hpp"
+#include "json_writer.hpp"
+#include "serialization.hpp"
+#include "journal.hpp"
+
+using json = nlohmann::json;
+
+std::string journal_filename(const char *savefile) {
+    return std::string(savefile) + JOURNAL_EXTENSION;
+}
+
+static void record_under_card(JournaledUnderCard& record, const Card& under_card) {
+    record.id = under_card.id;
+    record.revision = under_card.content_revision;
+    record.type = under_card.type;
+    record.tone = under_card.tone;
+    record.fontsize = under_card.fontsize;
+    record.saved_dimensions = under_card.saved_dimensions;
+}
+
+static bool same_under_card(const JournaledUnderCard& record, const Card& under_card) {
+    return record.revision == under_card.content_revision && record.type == under_card.type &&
+        record.tone == under_card.tone && record.fontsize == under_card.fontsize &&
+        record.saved_dimensions.x == under_card.saved_dimensions.x &&
+        record.saved_dimensions.y == under_card.saved_dimensions.y && record.id == under_card.id;
+}
+
+// Everything but the id, which doesn't change while a card stays in its slot.
+static void update_record(JournaledCard& record, const Card& card) {
+    record.revision = card.content_revision;
+    record.body_rect = card.body_rect;
+    record.tone = card.tone;
+    record.fontsize = card.fontsize;
+    record.is_beginning = card.is_beginning;
+    record.is_end = card.is_end;
+    record.lazy = card_is_lazy(card);
+    record.under.resize(record.lazy ? 0 : card.cards_under.size());
+    for (size_t i = 0; i < record.under.size(); i++) record_under_card(record.under[i], card.cards_under[i]);
+}
+
+static void write_under_card(JsonWriter& writer, const Card& under_card) {
+    json_begin_object(writer);
+    json_key(writer, "id");
+    json_string(writer, under_card.id);
+    json_key(writer, "type");
+    json_int(writer, under_card.type);
+    json_key(writer, "tone");
+    json_int(writer, under_card.tone);
+    json_key(writer, "content");
+    json_string(writer, under_card.content);
+    json_key(writer, "fontsize");
+    json_int(writer, under_card.fontsize);
+    json_key(writer, "saved_dimensions_x");
+    json_float(writer, under_card.saved_dimensions.x);
+    json_key(writer, "saved_dimensions_y");
+    json_float(writer, under_card.saved_dimensions.y);
+    json_end_object(writer);
+}
+
+static void write_under_cards(JsonWriter& writer, const Card& card) {
+    json_begin_array(writer);
+    for (auto &under_card: card.cards_under) write_under_card(writer, under_card);
+    json_end_array(writer);
+}
+
+// The same fields a save has for the card.
+static void write_card(JsonWriter& writer, const Card& card) {
+    json_begin_object(writer);
+    json_key(writer, "id");
+    json_string(writer, card.id);
+    json_key(writer, "type");
+    json_int(writer, card.type);
+    json_key(writer, "tone");
+    json_int(writer, card.tone);
+    json_key(writer, "x");
+    json_float(writer, card.body_rect.x);
+    json_key(writer, "y");
+    json_float(writer, card.body_rect.y);
+    json_key(writer, "w");
+    json_float(writer, card.body_rect.width);
+    json_key(writer, "h");
+    json_float(writer, card.body_rect.height);
+    json_key(writer, "content");
+    json_string(writer, card.content);
+    json_key(writer, "fontsize");
+    json_int(writer, card.fontsize);
+    json_key(writer, "cards_under");
+    write_under_cards(writer, card);
+    json_key(writer, "is_beginning");
+    json_bool(writer, card.is_beginning);
+    json_key(writer, "is_end");
+    json_bool(writer, card.is_end);
+    json_end_object(writer);
+}
+
+static void begin_operation(JsonWriter& writer, const char *operation, const std::string& id) {
+    json_begin_object(writer);
+    json_key(writer, "op");
+    json_string(writer, operation);
+    json_key(writer, "id");
+    json_string(writer, id);
+}
+
+static void end_operation(JsonWriter& writer) {
+    json_end_object(writer);
+    writer.out->put('\n');
+}
+
+// What's under `card` now, against what was journaled. A single card put in or taken out is written as such,
+// anything else as the whole list.
+static int journal_under_cards(JsonWriter& writer, const JournaledCard& record, const Card& card) {
+    auto &under = card.cards_under;
+    auto &old = record.under;
+    size_t common = std::min(under.size(), old.size());
+    size_t prefix = 0;
+    while (prefix < common && same_under_card(old[prefix], under[prefix])) prefix++;
+    if (prefix == under.size() && prefix == old.size()) return 0;
+    size_t suffix = 0;
+    while (suffix < common - prefix && same_under_card(old[old.size() - 1 - suffix], under[under.size() - 1 - suffix])) {
+        suffix++;
+    }
+    if (under.size() == old.size() + 1 && prefix + suffix == old.size()) {
+        begin_operation(writer, "scene_insert", card.id);
+        json_key(writer, "index");
+        json_int(writer, prefix);
+        json_key(writer, "card");
+        write_under_card(writer, under[prefix]);
+    } else if (old.size() == under.size() + 1 && prefix + suffix == under.size()) {
+        begin_operation(writer, "scene_remove", card.id);
+        json_key(writer, "under");
+        json_string(writer, old[prefix].id);
+    } else {
+        begin_operation(writer, "scenes", card.id);
+        json_key(writer, "cards_under");
+        write_under_cards(writer, card);
+    }
+    end_operation(writer);
+    return 1;
+}
+
+// Takes the board as it is as the starting point, as after loading or writing a save.
+void reset_journal(Journal& journal, const CardPool& cards) {
+    for (auto slot: card_hot.edited) card_hot.flags[slot] &= ~CARD_EDITED;
+    card_hot.edited.clear();
+    journal.cards.clear();
+    journal.cards.resize(cards.capacity);
+    for (auto it = begin(cards); it != end(cards); ++it) {
+        if (it->deleted) continue;
+        auto &record = journal.cards[it.index];
+        record.live = true;
+        record.id = it->id;
+        update_record(record, *it);
+    }
+}
+
+// Appends a line to `out` for every edit since the last call, and returns how many. Cards waiting to be
+// taken off the board already count as deleted. A card new to the journal is written whole, so a lazy one
+// gets read in first.
+// Only the slots on card_hot.edited are looked at, so this takes time in proportion to the edits, not the
+// board. They're taken in slot order, which writes the same lines as looking at every slot would.
+int journal_changes(Journal& journal, CardPool& cards, std::string& out) {
+    std::ostringstream stream;
+    auto writer = init_json_writer(stream);
+    int count = 0;
+    int slot_count = std::max<int>(cards.capacity, card_hot.flags.size());
+    if ((int) journal.cards.size() < slot_count) journal.cards.resize(slot_count);
+    // Reading in a lazy card below marks it edited again, which goes on a fresh list for next time.
+    static std::vector<int> edited;
+    edited.clear();
+    std::swap(edited, card_hot.edited);
+    std::sort(edited.begin(), edited.end());
+    for (auto slot: edited) card_hot.flags[slot] &= ~CARD_EDITED;
+    // Deletes go first: a card taken out from under another keeps its id, and can land in a slot before the
+    // one it was deleted from.
+    for (auto slot: edited) {
+        auto &record = journal.cards[slot];
+        Card *card = slot_is_live(cards, slot) && !pool_card(cards, slot).deleted ? &pool_card(cards, slot) : NULL;
+        if (record.live && (!card || card->id != record.id)) {
+            begin_operation(writer, "delete", record.id);
+            end_operation(writer);
+            count += 1;
+            record.live = false;
+            record.under.clear();
+        }
+    }
+    for (auto slot: edited) {
+        auto &record = journal.cards[slot];
+        Card *card = slot_is_live(cards, slot) && !pool_card(cards, slot).deleted ? &pool_card(cards, slot) : NULL;
+        if (!card) continue;
+        if (!record.live) {
+            load_lazy_card(*card);
+            begin_operation(writer, "create", card->id);
+            json_key(writer, "card");
+            write_card(writer, *card);
+            end_operation(writer);
+            count += 1;
+            record.live = true;
+            record.id = card->id;
+            update_record(record, *card);
+            continue;
+        }
+
+        auto &rect = card->body_rect;
+        if (rect.x != record.body_rect.x || rect.y != record.body_rect.y) {
+            begin_operation(writer, "move", card->id);
+            json_key(writer, "x");
+            json_float(writer, rect.x);
+            json_key(writer, "y");
+            json_float(writer, rect.y);
+            end_operation(writer);
+            count += 1;
+        }
+        if (rect.width != record.body_rect.width || rect.height != record.body_rect.height) {
+            begin_operation(writer, "resize", card->id);
+            json_key(writer, "w");
+            json_float(writer, rect.width);
+            json_key(writer, "h");
+            json_float(writer, rect.height);
+            end_operation(writer);
+            count += 1;
+        }
+        // The revision also changes with the name and tone, so this can write the same text again. A lazy card's
+        // text is still what its save has, whatever the revision says.
+        if (card->content_revision != record.revision && !card_is_lazy(*card)) {
+            begin_operation(writer, "text", card->id);
+            json_key(writer, "content");
+            json_string(writer, card->content);
+            end_operation(writer);
+            count += 1;
+        }
+        if (card->tone != record.tone) {
+            begin_operation(writer, "tone", card->id);
+            json_key(writer, "tone");
+            json_int(writer, card->tone);
+            end_operation(writer);
+            count += 1;
+        }
+        if (card->fontsize != record.fontsize) {
+            begin_operation(writer, "font", card->id);
+            json_key(writer, "fontsize");
+            json_int(writer, card->fontsize);
+            end_operation(writer);
+            count += 1;
+        }
+        if (card->is_beginning != record.is_beginning || card->is_end != record.is_end) {
+            begin_operation(writer, "flags", card->id);
+            json_key(writer, "is_beginning");
+            json_bool(writer, card->is_beginning);
+            json_key(writer, "is_end");
+            json_bool(writer, card->is_end);
+            end_operation(writer);
+            count += 1;
+        }
+        // A lazy card's cards_under only holds what was put under it since loading, so it's left until the
+        // card is read in, and then written whole.
+        if (!card_is_lazy(*card)) {
+            if (record.lazy) {
+                begin_operation(writer, "scenes", card->id);
+                json_key(writer, "cards_under");
+                write_under_cards(writer, *card);
+                end_operation(writer);
+                count += 1;
+            } else {
+                count += journal_under_cards(writer, record, *card);
+            }
+        }
+        update_record(record, *card);
+    }
+    out += stream.str();
+    return count;
+}
+
+// Missing keys, and values of the wrong type, read as zero unless said otherwise. A float that wasn't finite is saved as null.
+static float journal_float(const json& object, const char *key) {
+    auto it = object.find(key);
+    return it != object.end() && it->is_number() ? it->get<float>() : 0;
+}
+
+static int journal_int(const json& object, const char *key, int missing = 0) {
+    auto it = object.find(key);
+    return it != object.end() && it->is_number() ? it->get<int>() : missing;
+}
+
+static bool journal_bool(const json& object, const char *key) {
+    auto it = object.find(key);
+    return it != object.end() && it->is_boolean() && it->get<bool>();
+}
+
+static std::string journal_string(const json& object, const char *key) {
+    auto it = object.find(key);
+    return it != object.end() && it->is_string() ? it->get<std::string>() : std::string();
+}
+
+static const Card& blank_card() {
+    static Card blank = init_card("", {0, 0, GRIDSIZE * 17, GRIDSIZE * 13});
+    return blank;
+}
+
+// Enums that are missing or out of range are left as they are, as with a damaged save.
+static void read_card_style(const json& object, Card& card) {
+    int type = journal_int(object, "type", -1);
+    int tone = journal_int(object, "tone", -1);
+    int fontsize = journal_int(object, "fontsize", -1);
+    if (type >= PERIOD && type <= LEGACY) card.type = (CardType) type;
+    if (tone >= LIGHT && tone <= DARK) card.tone = (Tone) tone;
+    if (fontsize >= SMALL && fontsize <= LARGE) set_card_fontsize(card, (FontSize) fontsize);
+}
+
+static Card read_under_card(const json& object) {
+    Card under_card = blank_card();
+    touch_card_content(under_card);
+    if (!object.is_object()) return under_card;
+    under_card.id = journal_string(object, "id");
+    under_card.content = journal_string(object, "content");
+    read_card_style(object, under_card);
+    under_card.saved_dimensions.x = journal_float(object, "saved_dimensions_x");
+    under_card.saved_dimensions.y = journal_float(object, "saved_dimensions_y");
+    return under_card;
+}
+
+static void read_under_cards(const json& list, Card& card) {
+    card.cards_under.clear();
+    if (!list.is_array()) return;
+    for (auto &object: list) {
+        card.cards_under.push_back(read_under_card(object));
+        card.cards_under.back().parent = acquire_card_handle(card);
+    }
+}
+
+static Card read_card(const json& object) {
+    Card card = blank_card();
+    touch_card_content(card);
+    if (!object.is_object()) return card;
+    card.id = journal_string(object, "id");
+    card.content = journal_string(object, "content");
+    read_card_style(object, card);
+    card.body_rect.x = card.lock_target.x = journal_float(object, "x");
+    card.body_rect.y = card.lock_target.y = journal_float(object, "y");
+    card.body_rect.width = journal_float(object, "w");
+    card.body_rect.height = journal_float(object, "h");
+    card.is_beginning = journal_bool(object, "is_beginning");
+    card.is_end = journal_bool(object, "is_end");
+    auto under = object.find("cards_under");
+    if (under != object.end()) read_under_cards(*under, card);
+    return card;
+}
+
+// Applies the journal at `filename` to cards just loaded from its save, and returns how many operations it had.
+// Reading stops at the first line that doesn't parse, which is where the program stopped if it did so while
+// appending.
+int replay_journal(CardPool& cards, const char *filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) return 0;
+    std::unordered_map<std::string, int> by_id;
+    for (auto it = begin(cards); it != end(cards); ++it) {
+        if (!it->deleted) by_id[it->id] = it.index;
+    }
+
+    int count = 0;
+    std::string line;
+    while (std::getline(file, line)) {
+        auto operation = json::parse(line, nullptr, false);
+        if (operation.is_discarded() || !operation.is_object()) break;
+        count += 1;
+        auto name = journal_string(operation, "op");
+        auto id = journal_string(operation, "id");
+        auto found = by_id.find(id);
+        if (name == "create") {
+            if (found != by_id.end()) set_card_deleted(pool_card(cards, found->second), true);
+            auto card = operation.find("card");
+            if (card == operation.end()) continue;
+            add_card(cards, read_card(*card));
+            by_id[id] = cards.added.back();
+            continue;
+        }
+        // Operations on a card that's gone are from before it was deleted.
+        if (found == by_id.end()) continue;
+        auto &card = pool_card(cards, found->second);
+        if (name == "delete") {
+            set_card_deleted(card, true);
+            by_id.erase(found);
+        } else if (name == "move") {
+            auto rect = card.body_rect;
+            rect.x = journal_float(operation, "x");
+            rect.y = journal_float(operation, "y");
+            set_card_rect(card, rect);
+            set_card_target(card, {rect.x, rect.y});
+        } else if (name == "resize") {
+            auto rect = card.body_rect;
+            rect.width = journal_float(operation, "w");
+            rect.height = journal_float(operation, "h");
+            set_card_rect(card, rect);
+        } else if (name == "text") {
+            load_lazy_card(card);
+            card.content = journal_string(operation, "content");
+            touch_card_content(card);
+        } else if (name == "tone" || name == "font") {
+            read_card_style(operation, card);
+            touch_card_content(card);
+        } else if (name == "flags") {
+            card.is_beginning = journal_bool(operation, "is_beginning");
+            card.is_end = journal_bool(operation, "is_end");
+        } else if (name == "scene_insert") {
+            load_lazy_card(card);
+            auto under = operation.find("card");
+            if (under == operation.end()) continue;
+            auto under_card = read_under_card(*under);
+            under_card.parent = acquire_card_handle(card);
+            auto &list = card.cards_under;
+            list.erase(std::remove_if(list.begin(), list.end(), [&](const Card& c) { return c.id == under_card.id; }), list.end());
+            size_t index = std::min<size_t>(std::max(journal_int(operation, "index"), 0), list.size());
+            list.insert(list.begin() + index, under_card);
+        } else if (name == "scene_remove") {
+            load_lazy_card(card);
+            auto under_id = journal_string(operation, "under");
+            auto &list = card.cards_under;
+            auto it = std::find_if(list.begin(), list.end(), [&](const Card& c) { return c.id == under_id; });
+            if (it != list.end()) list.erase(it);
+        } else if (name == "scenes") {
+            load_lazy_card(card);
+            auto under = operation.find("cards_under");
+            if (under != operation.end()) read_under_cards(*under, card);
+        }
+    }
+    return count;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "common.hpp"
+#include "card.hpp"
+
+// The journal sits next to its save, named after it with this on the end.
+#define JOURNAL_EXTENSION ".journal"
+
+struct JournaledUnderCard {
+    std::string id;
+    unsigned int revision;
+    CardType type;
+    Tone tone;
+    FontSize fontsize;
+    Vector2 saved_dimensions;
+};
+
+// What the journal last recorded of the card in one pool slot.
+struct JournaledCard {
+    bool live;
+    std::string id;
+    unsigned int revision;
+    Rectangle body_rect;
+    Tone tone;
+    FontSize fontsize;
+    bool is_beginning;
+    bool is_end;
+    bool lazy; // Its cards_under is still in its save, so `under` is unknown
+    std::vector<JournaledUnderCard> under;
+};
+
+// An append-only log of card edits made since the save was last written in full. Each line is one JSON object
+// naming an operation and the card it applies to:
+//   create       the whole card, as it's saved, replacing any card with its id
+//   delete       id
+//   move         id, x, y
+//   resize       id, w, h
+//   text         id, content
+//   tone         id, tone
+//   font         id, fontsize
+//   flags        id, is_beginning, is_end
+//   scene_insert id, index, card: a card to put under it, replacing any there with its id
+//   scene_remove id, under: id of a card under it to take out
+//   scenes       id, cards_under: everything under it, when it changed in some other way
+// Operations carry the state a card ended up in rather than the change, so replaying some of them twice, as
+// happens if the program stops between writing a save and emptying its journal, ends in the same place.
+// Edits are found by comparing the cards on card_hot.edited with what was last journaled, so a card dragged
+// across the board between two calls to journal_changes is one move, not one per frame.
+struct Journal {
+    std::vector<JournaledCard> cards; // By pool slot
+};
+
+std::string journal_filename(const char *savefile);
+void reset_journal(Journal& journal, const CardPool& cards);
+int journal_changes(Journal& journal, CardPool& cards, std::string& out);
+int replay_journal(CardPool& cards, const char *filename);
@@ -0,0 +1,121 @@
+#include "json_writer.hpp"
+#include <cstdio>
+#include <cstring>
+
+JsonWriter init_json_writer(std::ostream& out) {
+    JsonWriter writer;
+    writer.out = &out;
+    writer.first_in_container = std::vector<bool>();
+    writer.after_key = false;
+    return writer;
+}
+
+// Puts a comma before every value but the first in its container. Values that follow a key already have their ':'.
+static void begin_value(JsonWriter& writer) {
+    if (writer.after_key) {
+        writer.after_key = false;
+        return;
+    }
+    if (writer.first_in_container.empty()) return;
+    if (!writer.first_in_container.back()) writer.out->put(',');
+    writer.first_in_container.back() = false;
+}
+
+static void begin_container(JsonWriter& writer, char open) {
+    begin_value(writer);
+    writer.out->put(open);
+    writer.first_in_container.push_back(true);
+}
+
+static void end_container(JsonWriter& writer, char close) {
+    writer.first_in_container.pop_back();
+    writer.out->put(close);
+}
+
+void json_begin_object(JsonWriter& writer) {
+    begin_container(writer, '{');
+}
+
+void json_end_object(JsonWriter& writer) {
+    end_container(writer, '}');
+}
+
+void json_begin_array(JsonWriter& writer) {
+    begin_container(writer, '[');
+}
+
+void json_end_array(JsonWriter& writer) {
+    end_container(writer, ']');
+}
+
+// Escapes quotes, backslashes and control characters. Everything else, UTF-8 included, is copied as is, in runs.
+static void write_escaped(JsonWriter& writer, const char *text, size_t length) {
+    writer.out->put('"');
+    size_t run_start = 0;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = text[i];
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        writer.out->write(text + run_start, i - run_start);
+        run_start = i + 1;
+        switch (c) {
+        case '"': writer.out->write("\\\"", 2); break;
+        case '\\': writer.out->write("\\\\", 2); break;
+        case '\n': writer.out->write("\\n", 2); break;
+        case '\r': writer.out->write("\\r", 2); break;
+        case '\t': writer.out->write("\\t", 2); break;
+        case '\b': writer.out->write("\\b", 2); break;
+        case '\f': writer.out->write("\\f", 2); break;
+        default: {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            writer.out->write(escaped, 6);
+            break;
+        }
+        }
+    }
+    writer.out->write(text + run_start, length - run_start);
+    writer.out->put('"');
+}
+
+void json_key(JsonWriter& writer, const char *key) {
+    begin_value(writer);
+    write_escaped(writer, key, strlen(key));
+    writer.out->put(':');
+    writer.after_key = true;
+}
+
+void json_string(JsonWriter& writer, const std::string& value) {
+    begin_value(writer);
+    write_escaped(writer, value.data(), value.size());
+}
+
+void json_string(JsonWriter& writer, const char *value, size_t length) {
+    begin_value(writer);
+    write_escaped(writer, value, length);
+}
+
+void json_int(JsonWriter& writer, long long value) {
+    begin_value(writer);
+    char number[32];
+    int length = snprintf(number, sizeof(number), "%lld", value);
+    writer.out->write(number, length);
+}
+
+// Nine significant digits are enough for every float to read back as the same float. JSON has no NaN or
+// infinity, so those are written as null.
+void json_float(JsonWriter& writer, float value) {
+    begin_value(writer);
+    if (!std::isfinite(value)) {
+        writer.out->write("null", 4);
+        return;
+    }
+    char number[32];
+    int length = snprintf(number, sizeof(number), "%.9g", value);
+    writer.out->write(number, length);
+}
+
+void json_bool(JsonWriter& writer, bool value) {
+    begin_value(writer);
+    if (value) writer.out->write("true", 4);
+    else writer.out->write("false", 5);
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "common.hpp"
+#include <ostream>
+
+// Writes JSON straight to a stream as it's produced, instead of building a document first. Commas and key/value
+// separators are placed automatically. It's up to the caller to open and close containers in the right order.
+struct JsonWriter {
+    std::ostream *out;
+    std::vector<bool> first_in_container; // One per open object or array
+    bool after_key; // The next value belongs to the key just written, so it doesn't need a comma
+};
+
+JsonWriter init_json_writer(std::ostream& out);
+void json_begin_object(JsonWriter& writer);
+void json_end_object(JsonWriter& writer);
+void json_begin_array(JsonWriter& writer);
+void json_end_array(JsonWriter& writer);
+void json_key(JsonWriter& writer, const char *key);
+void json_string(JsonWriter& writer, const std::string& value);
+void json_string(JsonWriter& writer, const char *value, size_t length);
+void json_int(JsonWriter& writer, long long value);
+void json_float(JsonWriter& writer, float value);
+void json_bool(JsonWriter& writer, bool value);
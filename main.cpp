@@ -18,10 +18,18 @@
 #include "player.hpp"
 #include "card.hpp"
 #include "card_pool.hpp"
+#include "card_cache.hpp"
 #include "palette.hpp"
 #include "search_box.hpp"
+#include "thread_pool.hpp"
 #include "drawer.hpp"
 #include "serialization.hpp"
+#include "autosave.hpp"
+#include "spatial_grid.hpp"
+#include "sprite_batch.hpp"
+#include "background_grid.hpp"
+#include "frame_pacer.hpp"
+#include "tinyfiledialogs.h"
 
 // #include "networking.hpp"
 
@@ -48,33 +56,31 @@ Font application_font_large;
 Texture2D spritesheet;
 Shader darken_shader;
 
-Texture generate_grid() {
-    auto data = std::vector<char>();
-    int gridsize = GRIDSIZE;
-    for (int y = 0; y < gridsize * 2; y++) {
-        for (int x = 0; x < gridsize * 2; x++) {
-            auto current_color = WHITE;
-            if ((x % gridsize == 0 || x % gridsize == gridsize - 1) && (y % gridsize == 0 || y % gridsize == gridsize - 1)) current_color = BLUE;
-            data.push_back(current_color.r);
-            data.push_back(current_color.g);
-            data.push_back(current_color.b);
-            data.push_back(current_color.a);
-        }
-    }
-    Image image = {data.data(), gridsize * 2, gridsize * 2, 1, UNCOMPRESSED_R8G8B8A8};
-    return LoadTextureFromImage(image);
-}
+SpatialGrid card_grid;
+std::vector<int> card_draw_order;
+SpriteBatch sprite_batch;
+CardHotStore card_hot;
+CardHandleTable card_handles;
+ThreadPool worker_pool;
 
 volatile int signal_handler = 1;
 void signal_func(int dummy) {
     signal_handler = 0;
 }
 
+// Whatever did load is kept on the board, but autosave is turned off so the file and its journal aren't
+// written over with it.
+static void load_failed(Autosave& autosave, const char *filename) {
+    suspend_autosave(autosave, filename);
+    tinyfd_messageBox("Save file could not be loaded",
+        TextFormat("%s could not be read in full, so part of the board may be missing. Autosave is off until the game is restarted, "
+            "so the file and its journal are left as they are.", filename), "ok", "warning", 1);
+}
+
 int main(void) {
     // Defer {if (is_server || is_client) enet_deinitialize();};
     SetTraceLogLevel(LOG_INFO);
     SetConfigFlags(FLAG_WINDOW_RESIZABLE);
-    SetTargetFPS(60);
     InitWindow(800, 600, "Microscope RPG");
     MaximizeWindow();
     SetExitKey(-1);
@@ -83,6 +89,7 @@ int main(void) {
     long spritesheet_modtime = GetFileModTime("assets/spritesheet.png");
     spritesheet = LoadTexture("assets/spritesheet.png");
     Defer {UnloadTexture(spritesheet);};
+    SetShapesTexture(spritesheet, SPRITESHEET_WHITE_TEXEL);
 
     auto logo = LoadImage("assets/logo.png");
     Defer {UnloadImage(logo);};
@@ -109,16 +116,37 @@ int main(void) {
     Project current_project = init_project("Scratch Buffer");
     Palette palette = init_palette();
     SearchBox search_box = init_search_box();
+    start_thread_pool(worker_pool, std::max(1u, std::thread::hardware_concurrency()) - 1);
+    Defer {stop_thread_pool(worker_pool);};
 
     Player player = init_player();
-    auto cards = std::vector<Card>();
-    if (FileExists("save.json")) {
-        load_cards(cards);
+    card_grid = init_spatial_grid();
+    sprite_batch = init_sprite_batch();
+    auto cards = init_pool();
+    Defer {free_pool(cards);};
+    // Without a save, a journal that replays nothing isn't a failure: there was nothing to lose.
+    bool loaded = true;
+    if (FileExists("save.json") || FileExists(journal_filename("save.json").c_str())) {
+        loaded = load_cards(cards) || !FileExists("save.json");
     }
+    Autosave autosave;
+    start_autosave(autosave, cards);
+    if (!loaded) load_failed(autosave, "save.json");
 
-    Texture grid_texture = generate_grid();
+    BackgroundGrid background_grid = init_background_grid();
+    Defer {unload_background_grid(background_grid);};
     Drawer drawer = init_drawer();
 
+    CardTextureCache card_cache = init_card_texture_cache();
+    Defer {clear_card_texture_cache(card_cache);};
+
+    int cards_drawn = 0;
+    int cards_culled = 0;
+    auto visible_cards = std::vector<std::pair<int, CachedCard*>>();
+
+    FramePacer frame_pacer = init_frame_pacer();
+    Defer {unload_frame_pacer(frame_pacer);};
+
     bool win_focus = IsWindowFocused();
     bool last_win_focus = win_focus;
 
@@ -127,28 +155,42 @@ int main(void) {
     #endif
 
     while (!WindowShouldClose() && signal_handler && !player.quit) {
+        // Only redraw when something could have changed since the last frame
         win_focus = IsWindowFocused();
-        if (win_focus != last_win_focus) {
-            SetTargetFPS(win_focus ? 60 : 10);
-        }
+        bool frame_dirty = input_happened(frame_pacer) || win_focus != last_win_focus || IsWindowResized();
         last_win_focus = win_focus;
+        auto last_camera = player.camera;
+
+        if (spritesheet_modtime != GetFileModTime("assets/spritesheet.png")) {
+            spritesheet = LoadTexture("assets/spritesheet.png");
+            spritesheet_modtime = GetFileModTime("assets/spritesheet.png");
+            SetShapesTexture(spritesheet, SPRITESHEET_WHITE_TEXEL);
+            clear_card_texture_cache(card_cache);
+            frame_dirty = true;
+        }
 
-        //update_networking(player);
+        //update_networking(player); // Should set frame_dirty when anything comes in
 
         if (main_menu.visible) {
-            update_cards(cards);
+            if (update_cards(cards)) frame_dirty = true;
             update_palette(palette);
             update_project(current_project);
             char opened_file[256] = {0};
             bool file_changed = false;
             bool new_game = false;
             update_menu(main_menu, GetMousePosition(), new_game, file_changed, opened_file);
-            if (file_changed) {
-                cards.clear();
-                update_cards(cards);
-                load_cards(cards, opened_file);
+            if (file_changed && !FileExists(opened_file)) {
+                // Nothing to load, so the board and save.json are left alone.
+                tinyfd_messageBox("Save file not found", TextFormat("%s doesn't exist.", opened_file), "ok", "warning", 1);
+            } else if (file_changed) {
+                clear_cards(cards);
+                if (load_cards(cards, opened_file)) rebase_autosave(autosave, cards);
+                else load_failed(autosave, opened_file);
+                clear_undo(player.undo);
             } else if (new_game) {
-                cards.clear();
+                clear_cards(cards);
+                rebase_autosave(autosave, cards);
+                clear_undo(player.undo);
             }
             goto draw;
         }
@@ -166,8 +208,8 @@ int main(void) {
             break;
         case WRITING:
             player_update_camera(player, false);
-            player_write_update(player);
-            player_resize_chosen_card(player);
+            player_write_update(player, cards);
+            player_resize_chosen_card(player, cards);
             break;
         case SEARCHING:
             player_search_update(player, search_box);
@@ -205,50 +247,78 @@ int main(void) {
         player.camera.target = lerp<Vector2>(floor(player.camera.target), floor(player.camera_target), 0.2);
         player.camera.zoom = lerp<float>(player.camera.zoom, player.camera_zoom_target, 0.2);
 
-        update_cards(cards);
+        if (player.camera.target.x != last_camera.target.x || player.camera.target.y != last_camera.target.y ||
+            player.camera.zoom != last_camera.zoom) frame_dirty = true;
+
+        if (update_cards(cards)) frame_dirty = true;
         update_palette(palette);
         update_project(current_project);
         update_drawer(drawer);
 
     draw:
-        BeginDrawing();
+        update_autosave(autosave, cards, frame_dirty);
+        set_frame_pacing(frame_pacer, !frame_dirty, win_focus);
+        if (!frame_needs_redraw(frame_pacer, frame_dirty)) {
+            // Normally reset by draw(). Only the card under the cursor can have been hovered.
+            if (Card *hovered = get_card(cards, player.hovered_card)) hovered->hover = false;
+            idle_frame(frame_pacer);
+            continue;
+        }
+
+        // Cards are drawn back to front, skipping the ones outside the view.
+        // The card cache renders into textures of its own, so it has to happen before the frame starts.
+        auto view_rect = get_camera_view_rect(player.camera);
+        begin_card_texture_cache_frame(card_cache);
+        cards_drawn = 0;
+        cards_culled = 0;
+        visible_cards.clear();
+        for (auto index: card_draw_order) {
+            if (!slot_is_live(cards, index)) continue; // The board was replaced since the last update_cards
+            auto &card = pool_card(cards, index);
+            check_card_hot(cards, index);
+            if (!collide(card_draw_bounds(card), view_rect)) {
+                card.hover = false;
+                cards_culled += 1;
+                continue;
+            }
+            cards_drawn += 1;
+            load_lazy_card(card);
+            visible_cards.push_back({index, prepare_cached_card(card_cache, card, player.camera)});
+        }
+
+        begin_frame(frame_pacer);
         BeginMode2D(player.camera);
         ClearBackground(RAYWHITE);
-        // Draw Background Grid
-        auto src = (Rectangle) {-100000, -100000, 200000, 200000};
-        auto dst = src;
-        DrawTexturePro(grid_texture, src, dst, (Vector2){0, 0}, 0, WHITE);
-        // Draw Description Lines and Big Picture
-        DrawLineEx((Vector2) {0, -100000}, (Vector2) {0, 100000}, 3.0, SKYBLUE);
-        DrawLineEx((Vector2) {-100000, 0}, (Vector2) {100000, 0}, 3.0, SKYBLUE);
+        // Draw Background Grid and Description Lines
+        draw_background_grid(background_grid, player.camera);
+        // Draw Big Picture
         DrawRectangle(1, 1, MeasureTextEx(application_font_regular, current_project.big_picture.c_str(), FONTSIZE_REGULAR, 1.0).x + 16, MeasureTextEx(application_font_regular, current_project.big_picture.c_str(), FONTSIZE_REGULAR, 1.0).y, SKYBLUE);
         DrawTextEx(application_font_regular, current_project.big_picture.c_str(), {8, -1}, FONTSIZE_REGULAR, 1.0, BLACK);
 
-        // Depth sorting for cards
-        // TODO use std stuff
-        int current_depth = smallest_depth(cards);
-        while (true) {
-            bool every_card_undrawn = true;
-            for (auto &card: cards) {
-                if (card.drawn) {
-                    continue;
-                } else {
-                    every_card_undrawn = false;
-                    if (card.depth == current_depth) {
-                        if (card.type != player.card_focus && player.is_card_type_focus) BeginShaderMode(darken_shader);
-                        draw(card, player.camera);
-                        if (card.type != player.card_focus && player.is_card_type_focus) EndShaderMode();
-                    }
-                }
-            }
-            if (every_card_undrawn) {
-                break;
+        // Cards that don't overlap each other and share a shader go to the GPU as one band.
+        bool band_darkened = false;
+        auto flush_band = [&]() {
+            if (band_darkened) BeginShaderMode(darken_shader);
+            flush_sprite_batch(sprite_batch);
+            if (band_darkened) EndShaderMode();
+        };
+        begin_sprite_batch(sprite_batch);
+        for (auto visible_card: visible_cards) {
+            int index = visible_card.first;
+            auto cached_card = visible_card.second;
+            auto &card = pool_card(cards, index);
+            auto bounds = card_draw_bounds(card);
+            bool darkened = card.type != player.card_focus && player.is_card_type_focus;
+            if (darkened != band_darkened || overlaps_sprite_band(sprite_batch, bounds)) {
+                flush_band();
+                band_darkened = darkened;
             }
-            current_depth += 1;
-        }
-        for (auto &card: cards) {
-            card.drawn = false;
+            add_to_sprite_band(sprite_batch, index, bounds);
+            if (cached_card) draw_cached_card(card_cache, *cached_card, card);
+            else draw(card, player.camera, player_text_on(player, card));
         }
+        flush_band();
+        end_sprite_batch(sprite_batch);
 
         //DrawRectangleRec((Rectangle) {external_data.x, external_data.y, 10, 10}, RED);
 
@@ -269,9 +339,9 @@ int main(void) {
         draw(current_project);
         // Draw palette
         draw(palette);
-        if (search_box.visible) draw_search_box(search_box);
+        if (search_box.visible) draw_search_box(search_box, cards);
         if (main_menu.visible) draw_menu(main_menu);
-        if (drawer.open) draw_drawer(drawer, player.camera);
+        if (drawer.open) draw_drawer(drawer, cards, player.camera);
 
         switch (player.state) {
         case WRITING:
@@ -294,18 +364,19 @@ int main(void) {
             break;
         }
 
+        const char *cull_text = TextFormat("%d cards drawn (%d cached), %d culled, %d batches", cards_drawn, card_cache.hits_this_frame, cards_culled, sprite_batch.draw_calls);
+        DrawText(cull_text, GetScreenWidth() - MeasureText(cull_text, 16) - 4, GetScreenHeight() - 16, 16, BLACK);
+        const char *autosave_text = autosave_status(autosave);
+        DrawText(autosave_text, GetScreenWidth() - MeasureText(autosave_text, 16) - 4, GetScreenHeight() - 32, 16, BLACK);
+
         // Draw player cursor over everything.
         player.player_rect.x = GetMousePosition().x;
         player.player_rect.y = GetMousePosition().y;
         DrawRectangleRec(player.player_rect, BLUE);
-        EndDrawing();
-
-        if (spritesheet_modtime != GetFileModTime("assets/spritesheet.png")) {
-            spritesheet = LoadTexture("assets/spritesheet.png");
-            spritesheet_modtime = GetFileModTime("assets/spritesheet.png");
-        }
+        end_frame(frame_pacer);
     }
-    save_cards(cards);
+    // Normally everything is in the save and its journal by now.
+    if (!stop_autosave(autosave, cards)) save_cards(cards);
 
     return 0;
 }
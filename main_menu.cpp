@@ -50,8 +50,11 @@ void update_menu(MainMenu& menu, Vector2 mouse_position, bool& new_game, bool& o
                                                 NULL,
                                                 NULL,
                                                 0);
-            if (result != NULL) strcpy(opened_file, result);
-            opened_save_file = true;
+            // NULL when the dialog was cancelled, which leaves the board as it is.
+            if (result != NULL) {
+                strcpy(opened_file, result);
+                opened_save_file = true;
+            }
             return;
         } else if (menu.settings.hover) {
             return;
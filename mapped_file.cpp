@@ -0,0 +1,77 @@
+#include "mapped_file.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+bool map_file(MappedFile& file, const char *filename) {
+    file.data = NULL;
+    file.size = 0;
+    file.mapping = NULL;
+    HANDLE handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0) {
+        CloseHandle(handle);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    // The view keeps the file open, so the handle isn't needed past this point.
+    CloseHandle(handle);
+    if (mapping == NULL) return false;
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == NULL) {
+        CloseHandle(mapping);
+        return false;
+    }
+    file.data = (const char*) data;
+    file.size = size.QuadPart;
+    file.mapping = mapping;
+    return true;
+}
+
+void unmap_file(MappedFile& file) {
+    if (file.data) UnmapViewOfFile(file.data);
+    if (file.mapping) CloseHandle(file.mapping);
+    file.data = NULL;
+    file.size = 0;
+    file.mapping = NULL;
+}
+
+#else
+
+bool map_file(MappedFile& file, const char *filename) {
+    file.data = NULL;
+    file.size = 0;
+    file.mapping = NULL;
+    int descriptor = open(filename, O_RDONLY);
+    if (descriptor == -1) return false;
+    struct stat info;
+    if (fstat(descriptor, &info) == -1 || info.st_size == 0) {
+        close(descriptor);
+        return false;
+    }
+    void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    // The mapping keeps the file open, so the descriptor isn't needed past this point.
+    close(descriptor);
+    if (data == MAP_FAILED) return false;
+    file.data = (const char*) data;
+    file.size = info.st_size;
+    return true;
+}
+
+void unmap_file(MappedFile& file) {
+    if (file.data) munmap((void*) file.data, file.size);
+    file.data = NULL;
+    file.size = 0;
+}
+
+#endif
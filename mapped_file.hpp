@@ -0,0 +1,13 @@
+#pragma once
+#include <cstddef>
+
+// A file mapped read-only into memory. Pages are only read from disk when something touches them.
+// Deliberately doesn't include raylib: windows.h, which the Windows side needs, clashes with it.
+struct MappedFile {
+    const char *data;
+    size_t size;
+    void *mapping; // The file mapping object on Windows, unused elsewhere
+};
+
+bool map_file(MappedFile& file, const char *filename);
+void unmap_file(MappedFile& file);
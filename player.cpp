@@ -1,10 +1,13 @@
 #include "card.hpp"
+#include "card_pool.hpp"
+#include "arrange.hpp"
 #include "common.hpp"
 #include "player.hpp"
 #include "drawer.hpp"
 #include "networking.hpp"
 #include "main_menu.hpp"
 #include "search_box.hpp"
+#include "serialization.hpp"
 
 Player init_player() {
     Player player;
@@ -38,14 +41,22 @@ Player init_player() {
 
     player.hold_origin = {0};
     player.hold_diff = {0};
+    player.selection_rec = {0};
+    player.selection_world_rec = {0};
 
-    player.selected_card = NULL;
+    player.selected_card = NO_CARD;
+    player.hovered_card = NO_CARD;
     player.offset = {0, 0};
     player.resizing_card = false;
+    init_text_buffer(player.text, "");
+    player.text_card = NO_CARD;
+    player.text_field = BODY;
+    player.text_revision = 0;
+    clear_undo(player.undo);
     return player;
 }
 
-void spawn_card(Player player, std::vector<Card>& cards, CardType type) {
+void spawn_card(Player& player, CardPool& cards, CardType type) {
     auto mouse_position = GetMousePosition();
     auto position = GetScreenToWorld2D(mouse_position, player.camera);
     Rectangle to_draw = {position.x, position.y, GRIDSIZE * 17, GRIDSIZE * 13};
@@ -59,7 +70,9 @@ void spawn_card(Player player, std::vector<Card>& cards, CardType type) {
     auto next_card = greatest_depth_and_furthest_along(cards);
     if (next_card) the_card.depth = next_card->depth + 1;
     else the_card.depth = 0;
-    cards.push_back(the_card);
+    acquire_card_handle(the_card);
+    record_card_created(player.undo, the_card);
+    add_card(cards, the_card);
 }
 
 void player_update_camera(Player &player, bool allow_key_scroll) {
@@ -113,67 +126,166 @@ void player_update_camera(Player &player, bool allow_key_scroll) {
     #undef ZOOM_SIZE
 }
 
-void player_write_update(Player& player) {
+// Fills the buffer with the text about to be written, unless it has it already and nothing else has changed it.
+static void load_player_text(Player& player, Card& card) {
+    if (player.text_card == card.handle && player.text_field == player.editing && player.text_revision == card.content_revision) return;
+    init_text_buffer(player.text, player.editing == NAME ? card.name : card.content);
+    player.text_card = card.handle;
+    player.text_field = player.editing;
+    player.text_revision = card.content_revision;
+}
+
+// Replaces the text from `start` to `end` in the buffer, keeping the undo history. False if nothing changed.
+static bool edit_player_text(Player& player, Card& card, size_t start, size_t end, const std::string& inserted) {
+    if (start == end && inserted.empty()) return false;
+    record_text_edit(player.undo, card, player.editing == NAME, start, text_buffer_range(player.text, start, end), inserted);
+    replace_text(player.text, start, end, inserted.data(), inserted.size());
+    return true;
+}
+
+// The text to draw a caret and selection in on `card`, if the player is writing on it.
+const TextBuffer* player_text_on(const Player& player, const Card& card) {
+    if (player.state != WRITING || player.editing != BODY || card.handle != player.selected_card) return NULL;
+    if (player.text_card != card.handle || player.text_field != BODY || player.text_revision != card.content_revision) return NULL;
+    return &player.text;
+}
+
+void player_write_update(Player& player, CardPool& cards) {
+    Card *selected_card = get_card(cards, player.selected_card);
+    if (!selected_card) {
+        player.state = HOVERING;
+        return;
+    }
     if (IsKeyPressed(KEY_ESCAPE)) {
         if (player.editing == NAME) {
-            if (player.selected_card->name.empty()) player.selected_card->name = player.selected_card->last_name;
+            if (selected_card->name.empty()) {
+                selected_card->name = selected_card->last_name;
+                record_text_edit(player.undo, *selected_card, true, 0, "", selected_card->name);
+            }
+            touch_card_content(*selected_card);
         }
         player.state = HOVERING;
-        player.selected_card->grabbed = false;
-        player.selected_card->selected = false;
-        player.selected_card->draw_resize = false;
-        player.selected_card = NULL;
+        set_card_grabbed(*selected_card, false);
+        set_card_selected(*selected_card, false);
+        selected_card->draw_resize = false;
+        player.selected_card = NO_CARD;
         return;
     }
-    if (IsKeyPressed(KEY_BACKSPACE)) {
-        if (player.editing == NAME && player.selected_card->name.size() > 0) {
-            player.selected_card->name.pop_back();
-        }
-        else if (player.editing == BODY && player.selected_card->content.size() > 0) {
-            player.selected_card->content.pop_back();
+    load_player_text(player, *selected_card);
+    auto &text = player.text;
+    size_t length = text_buffer_length(text);
+    bool shift = IsKeyDown(KEY_LEFT_SHIFT) || IsKeyDown(KEY_RIGHT_SHIFT);
+    bool control = IsKeyDown(KEY_LEFT_CONTROL) || IsKeyDown(KEY_RIGHT_CONTROL);
+
+    // Caret movement. Shift selects on the way, control goes a word at a time, or to either end of the text.
+    if (IsKeyPressed(KEY_LEFT)) {
+        if (has_selection(text) && !shift) move_caret(text, selection_start(text), false);
+        else move_caret(text, control ? previous_word(text, text.caret) : previous_codepoint(text, text.caret), shift);
+    } else if (IsKeyPressed(KEY_RIGHT)) {
+        if (has_selection(text) && !shift) move_caret(text, selection_end(text), false);
+        else move_caret(text, control ? next_word(text, text.caret) : next_codepoint(text, text.caret), shift);
+    } else if (IsKeyPressed(KEY_UP)) {
+        move_caret(text, line_above(text, text.caret), shift);
+    } else if (IsKeyPressed(KEY_DOWN)) {
+        move_caret(text, line_below(text, text.caret), shift);
+    } else if (IsKeyPressed(KEY_HOME)) {
+        move_caret(text, control ? 0 : line_start(text, text.caret), shift);
+    } else if (IsKeyPressed(KEY_END)) {
+        move_caret(text, control ? length : line_end(text, text.caret), shift);
+    }
+
+    bool edited = false;
+    size_t start = selection_start(text);
+    size_t end = selection_end(text);
+    if (control) {
+        if (IsKeyPressed(KEY_A)) {
+            move_caret(text, 0, false);
+            move_caret(text, length, true);
+        } else if (IsKeyPressed(KEY_C) && has_selection(text)) {
+            SetClipboardText(text_buffer_range(text, start, end).c_str());
+        } else if (IsKeyPressed(KEY_X) && has_selection(text)) {
+            SetClipboardText(text_buffer_range(text, start, end).c_str());
+            edited |= edit_player_text(player, *selected_card, start, end, "");
+        } else if (IsKeyPressed(KEY_V)) {
+            const char *clipboard = GetClipboardText();
+            if (clipboard != NULL) edited |= edit_player_text(player, *selected_card, start, end, clipboard);
         }
-        return;
     }
-    if (IsKeyPressed(KEY_ENTER)) {
-        if (player.editing == NAME) return;
-        player.selected_card->content += (char) '\n';
-    }
-    // Typing
-    if (player.selected_card) {
-        auto char_pressed = GetCharPressed();
-        if (char_pressed != 0) {
-            if (player.editing == NAME) {
-                player.selected_card->name += (char) char_pressed;
-            } else {
-                player.selected_card->content += (char) char_pressed;
-            }
-        }
+    if (IsKeyPressed(KEY_BACKSPACE)) {
+        if (!has_selection(text)) start = control ? previous_word(text, text.caret) : previous_codepoint(text, text.caret);
+        edited |= edit_player_text(player, *selected_card, start, end, "");
+    } else if (IsKeyPressed(KEY_DELETE)) {
+        if (!has_selection(text)) end = control ? next_word(text, text.caret) : next_codepoint(text, text.caret);
+        edited |= edit_player_text(player, *selected_card, start, end, "");
+    } else if (IsKeyPressed(KEY_ENTER) && player.editing != NAME) {
+        edited |= edit_player_text(player, *selected_card, start, end, "\n");
+    }
+    // Typing. Everything typed since last frame goes in now.
+    int char_pressed;
+    while ((char_pressed = GetCharPressed()) != 0) {
+        if (char_pressed < ' ') continue;
+        int size = 0;
+        const char *typed = CodepointToUtf8(char_pressed, &size);
+        edited |= edit_player_text(player, *selected_card, selection_start(text), selection_end(text), std::string(typed, size));
+    }
+
+    // The card's copy is only rewritten once a frame, however many edits there were.
+    if (edited) {
+        copy_text_buffer(text, player.editing == NAME ? selected_card->name : selected_card->content);
+        touch_card_content(*selected_card);
+        player.text_revision = selected_card->content_revision;
     }
 }
 
-void player_resize_chosen_card(Player& player) {
+void player_resize_chosen_card(Player& player, CardPool& cards) {
     auto mouse_position = GetMousePosition();
     auto position = GetScreenToWorld2D(mouse_position, player.camera);
-    Card *card = player.selected_card;
+    Card *card = get_card(cards, player.selected_card);
     if (!card) return;
 
     auto mouse_over_button = CheckCollisionPointRec(position, card->edit_button.rect);
     if (IsMouseButtonPressed(0) && mouse_over_button) {
         player.resizing_card = true;
+        watch_card_position(player.undo, *card);
     } else if (IsMouseButtonReleased(0)) {
+        if (player.resizing_card) record_card_moves(player.undo, cards);
         player.resizing_card = false;
     }
 
     if (!player.resizing_card) return;
     auto mouse_delta = get_mouse_delta() * (1.0 / player.camera.zoom);
-    card->body_rect.width += mouse_delta.x;
-    card->body_rect.height += mouse_delta.y;
-    if (card->body_rect.width < GRIDSIZE * 11) card->body_rect.width = GRIDSIZE * 11;
-    if (card->body_rect.height < GRIDSIZE * 11) card->body_rect.height = GRIDSIZE * 11;
+    auto rect = card->body_rect;
+    rect.width += mouse_delta.x;
+    rect.height += mouse_delta.y;
+    if (rect.width < GRIDSIZE * 11) rect.width = GRIDSIZE * 11;
+    if (rect.height < GRIDSIZE * 11) rect.height = GRIDSIZE * 11;
+    set_card_rect(*card, rect);
+}
+
+static void update_card_buttons_hover(Card& card, Vector2 position) {
+    update_button_hover(card.close_button, position);
+    update_button_hover(card.edit_button, position);
+    update_button_hover(card.tone_button, position);
+    update_button_hover(card.increase_font_button, position);
+    update_button_hover(card.decrease_font_button, position);
+    if (card.type == EVENT) {
+        update_button_hover(card.scene_insert_button, position);
+        update_button_hover(card.scene_remove_button, position);
+    }
+}
+
+static void clear_card_buttons_hover(Card& card) {
+    card.close_button.hover = false;
+    card.edit_button.hover = false;
+    card.tone_button.hover = false;
+    card.increase_font_button.hover = false;
+    card.decrease_font_button.hover = false;
+    card.scene_insert_button.hover = false;
+    card.scene_remove_button.hover = false;
 }
 
 // This is the main meat of the program.
-void player_hover_update(Player& player, std::vector<Card>& cards, Palette& palette, Project &project, Drawer& drawer, MainMenu &main_menu, SearchBox& search_box) {
+void player_hover_update(Player& player, CardPool& cards, Palette& palette, Project &project, Drawer& drawer, MainMenu &main_menu, SearchBox& search_box) {
     auto mouse_position = GetMousePosition();
     auto position = GetScreenToWorld2D(mouse_position, player.camera);
     player.player_rect.x = position.x;
@@ -183,113 +295,111 @@ void player_hover_update(Player& player, std::vector<Card>& cards, Palette& pale
     // update_button_hover(project.start_server, mouse_position);
     // update_button_hover(project.start_client, mouse_position);
 
-    // We need to initialize this value to the first card because if it's null, we can't check if the player is over a card.
-    Card *player_card_over = &cards[0]; // Card that the player is hovering over
-    bool found_card = false;
+    Card *selected_card = get_card(cards, player.selected_card);
+    Card *player_card_over = NULL; // Card that the player is hovering over
+    // Only cards filed near the cursor can have a button under it. The cards that were near it last frame let go of
+    // their buttons first, since the cursor may have left their cell.
+    static std::vector<int> nearby_cards;
+    for (auto index: nearby_cards) {
+        if (slot_is_live(cards, index)) clear_card_buttons_hover(pool_card(cards, index));
+    }
+    nearby_cards.clear();
     // Mouse and Card Selection
-    for (auto &card: cards) {
-        if (palette.open_button.hover) break; // skip checking the cards if the players is hovering over the palette open thingie
-        if (card.parent != NULL) continue;
-        if (CheckCollisionPointRec(position, card.body_rect)) {
-            found_card = true;
-            if (card.depth < player_card_over->depth && CheckCollisionPointRec(position, player_card_over->body_rect)) {
-                continue;
-            }
-            player_card_over = &card;
+    if (!palette.open_button.hover) { // skip checking the cards if the players is hovering over the palette open thingie
+        player_card_over = card_at(cards, position);
+
+        query_spatial_grid(card_grid, position, nearby_cards);
+        for (auto index: nearby_cards) {
+            if (!slot_is_live(cards, index)) continue;
+            auto &card = pool_card(cards, index);
+            if (card.parent != NO_CARD) continue;
+            update_card_buttons_hover(card, position);
         }
-        update_button_hover(card.close_button, position);
-        update_button_hover(card.edit_button, position);
-        update_button_hover(card.tone_button, position);
-        update_button_hover(card.increase_font_button, position);
-        update_button_hover(card.decrease_font_button, position);
-        if (card.type == EVENT) {
-            update_button_hover(card.scene_insert_button, position);
-            update_button_hover(card.scene_remove_button, position);
-        }
-    }
-    if (!found_card) {
-        player_card_over = NULL;
     }
 
     if (player_card_over != NULL) {
         player_card_over->hover = true;
+        player.hovered_card = player_card_over->handle;
     }
 
     if (IsMouseButtonPressed(0) && player_card_over != NULL) {
         player.mouse_held = true;
-        player.selected_card = player_card_over;
-        player.offset = {player.player_rect.x - player.selected_card->body_rect.x, player.player_rect.y - player.selected_card->body_rect.y};
-        player_card_over->grabbed = true;
+        player.selected_card = player_card_over->handle;
+        selected_card = player_card_over;
+        player.offset = {player.player_rect.x - selected_card->body_rect.x, player.player_rect.y - selected_card->body_rect.y};
+        set_card_grabbed(*player_card_over, true);
+        // Where the cards about to be dragged start from, so the drag can be undone.
+        record_card_moves(player.undo, cards);
+        if (!player_card_over->selected) watch_card_position(player.undo, *player_card_over);
+        for (auto &card: cards) {
+            if (card.selected) watch_card_position(player.undo, card);
+        }
     }
 
-    if (IsMouseButtonPressed(0) && player.selected_card) {
+    if (IsMouseButtonPressed(0) && selected_card) {
         auto deepest_card = greatest_depth_and_furthest_along(cards);
-        player.selected_card->depth = deepest_card->depth + 1;
+        set_card_depth(*selected_card, deepest_card->depth + 1);
+        auto style = card_style(*selected_card);
         // Card button clicked!
-        if (player.selected_card->close_button.hover) {
-            player.selected_card->deleted = true;
+        if (selected_card->close_button.hover) {
+            record_cards_deleted(player.undo, {selected_card});
+            set_card_deleted(*selected_card, true);
             player.mouse_held = false;
             player.offset = {0 ,0};
             return;
-        } else if (player.selected_card->edit_button.hover) {
+        } else if (selected_card->edit_button.hover) {
             player.state = WRITING;
             player.editing = BODY;
             player.mouse_held = false;
-            player.selected_card->draw_resize = true;
+            selected_card->draw_resize = true;
             player.offset = {0 ,0};
-        } else if (player.selected_card->tone_button.hover) {
-            if (player.selected_card->tone == LIGHT) {
-                player.selected_card->tone  = DARK;
+        } else if (selected_card->tone_button.hover) {
+            if (selected_card->tone == LIGHT) {
+                selected_card->tone  = DARK;
             } else {
-                player.selected_card->tone  = LIGHT;
+                selected_card->tone  = LIGHT;
             }
-        } else if (player.selected_card->increase_font_button.hover) {
-            FontSize *the_size = &player.selected_card->fontsize;
-            switch (player.selected_card->fontsize) {
+            touch_card_content(*selected_card);
+        } else if (selected_card->increase_font_button.hover) {
+            switch (selected_card->fontsize) {
             case SMALL: 
-                *the_size = REGULAR;
-                player.selected_card->font = &application_font_regular;
+                set_card_fontsize(*selected_card, REGULAR);
                 break;
             case REGULAR: 
-                *the_size = LARGE;
-                player.selected_card->font = &application_font_large;
+                set_card_fontsize(*selected_card, LARGE);
                 break;
             case LARGE: 
-                *the_size = SMALL;
-                player.selected_card->font = &application_font_small;
+                set_card_fontsize(*selected_card, SMALL);
                 break;
             }
-        } else if (player.selected_card->decrease_font_button.hover) {
-            FontSize *the_size = &player.selected_card->fontsize;
-            switch (player.selected_card->fontsize) {
+        } else if (selected_card->decrease_font_button.hover) {
+            switch (selected_card->fontsize) {
             case SMALL: 
-                *the_size = LARGE;
-                player.selected_card->font = &application_font_large;
+                set_card_fontsize(*selected_card, LARGE);
                 break;
             case REGULAR: 
-                *the_size = SMALL;
-                player.selected_card->font = &application_font_small;
+                set_card_fontsize(*selected_card, SMALL);
                 break;
             case LARGE: 
-                *the_size = REGULAR;
-                player.selected_card->font = &application_font_regular;
+                set_card_fontsize(*selected_card, REGULAR);
                 break;
             }
-        } else if (player.selected_card->scene_insert_button.hover) {
+        } else if (selected_card->scene_insert_button.hover) {
             player.state = SCENECARDSELECTING;
             player.card_focus = SCENE;
             player.is_card_type_focus = true;
             player.mouse_held = false;
             player.offset = {0, 0};
             return;
-        } else if (player.selected_card->scene_remove_button.hover) {
+        } else if (selected_card->scene_remove_button.hover) {
             player.state = DRAWERCARDSELECTING;
             drawer.open = true;
-            drawer.cards = &player.selected_card->cards_under;
+            drawer.owner = player.selected_card;
             player.mouse_held = false;
             player.offset = {0, 0};
             return;
         }
+        record_style_change(player.undo, *selected_card, style);
     } else if (IsMouseButtonPressed(0)) { // Player clicks, but is not on a card
         if (palette.open_button.hover) {
             toggle_palette(palette);
@@ -322,33 +432,39 @@ void player_hover_update(Player& player, std::vector<Card>& cards, Palette& pale
         else {
             player.state = GRABBING; // Background drag
             player.hold_origin = GetMousePosition();
+            player.selection_world_rec = {0};
+            // A new drag starts a new selection.
+            for (auto &card: cards) set_card_selected(card, false);
             return;
         }
-    } else if (IsMouseButtonReleased(0) && player.selected_card) { // Player releases a card
-        auto position_to_lock_to = lock_position_to_grid((Vector2) {player.selected_card->body_rect.x, player.selected_card->body_rect.y});
-        player.selected_card->lock_target = position_to_lock_to;
-        player.selected_card->grabbed = false;
+    } else if (IsMouseButtonReleased(0) && selected_card) { // Player releases a card
+        auto position_to_lock_to = lock_position_to_grid((Vector2) {selected_card->body_rect.x, selected_card->body_rect.y});
+        set_card_target(*selected_card, position_to_lock_to);
+        set_card_grabbed(*selected_card, false);
         for (auto& card: cards) {
             if (!card.selected) continue;
             position_to_lock_to = lock_position_to_grid((Vector2) {card.body_rect.x, card.body_rect.y});
-            card.lock_target = position_to_lock_to;
-            card.selected = false;
+            set_card_target(card, position_to_lock_to);
+            set_card_selected(card, false);
         }
+        record_card_moves(player.undo, cards);
 
         player.mouse_held = false;
         player.offset = {0, 0};
-        player.selected_card = NULL;
+        player.selected_card = NO_CARD;
+        selected_card = NULL;
     } 
 
     // Move grabbed and selected cards.
-    if (player.mouse_held && player.selected_card) {
-        player.selected_card->body_rect.x = position.x - player.offset.x;
-        player.selected_card->body_rect.y = position.y - player.offset.y;
+    if (player.mouse_held && selected_card) {
+        auto rect = selected_card->body_rect;
+        rect.x = position.x - player.offset.x;
+        rect.y = position.y - player.offset.y;
+        set_card_rect(*selected_card, rect);
         for (auto& card: cards) {
             if (card.selected) {
                 auto mouse_delta = get_mouse_delta() * (1.0/player.camera.zoom);
-                card.lock_target.x += mouse_delta.x;
-                card.lock_target.y += mouse_delta.y;
+                set_card_target(card, card.lock_target + mouse_delta);
             }
         }
     }
@@ -368,10 +484,16 @@ void player_hover_update(Player& player, std::vector<Card>& cards, Palette& pale
     }
 
     if (IsKeyPressed(KEY_F9) && player_card_over != NULL) {
+        auto style = card_style(*player_card_over);
         player_card_over->is_beginning = !player_card_over->is_beginning;
+        mark_card_edited(*player_card_over);
+        record_style_change(player.undo, *player_card_over, style);
     }
     if (IsKeyPressed(KEY_F10) && player_card_over != NULL) {
+        auto style = card_style(*player_card_over);
         player_card_over->is_end = !player_card_over->is_end;
+        mark_card_edited(*player_card_over);
+        record_style_change(player.undo, *player_card_over, style);
     }
 
     // Change big picture
@@ -393,81 +515,58 @@ void player_hover_update(Player& player, std::vector<Card>& cards, Palette& pale
             search_box.visible = true;
             player.state = SEARCHING;
             return;
+        } else if (IsKeyPressed(KEY_Z)) {
+            if (IsKeyDown(KEY_LEFT_SHIFT) || IsKeyDown(KEY_RIGHT_SHIFT)) redo_step(player.undo, cards);
+            else undo_step(player.undo, cards);
+        } else if (IsKeyPressed(KEY_Y)) {
+            redo_step(player.undo, cards);
         }
     }
 
     // Delete cards
     if (IsKeyPressed(KEY_DELETE)) {
+        std::vector<Card*> deleted;
         for (auto &card: cards) {
-            card.deleted = card.selected;
+            if (card.selected && !card.deleted) deleted.push_back(&card);
         }
+        record_cards_deleted(player.undo, deleted);
+        for (auto card: deleted) set_card_deleted(*card, true);
     }
 
     if (IsKeyPressed(KEY_ESCAPE)) {
         main_menu.visible = true;
     }
 
+    // Arrange selected cards
+    ArrangeMode arrange_mode;
+    bool arrange = true;
     if (IsKeyPressed(KEY_H)) {
-        print(200);
-        std::vector<Card> x_cards;
-        std::copy_if(cards.begin(), cards.end(), std::back_inserter(x_cards), [](auto& card){return card.selected;});
-        std::sort(x_cards.begin(), x_cards.end(), [](auto& card1, auto& card2) {
-            return card1.body_rect.x < card2.body_rect.x;
-        });
-        float move = 0;
-        for (auto &card: x_cards) {
-            card.lock_target = {position.x + move, position.y};
-            move += card.body_rect.width;
-        }
-        // This is so slow! We need to just use references or pointers or whatever instead.
-        for (auto &card: cards) {
-            for (auto &mod_card: x_cards) {
-                if (card == mod_card) {
-                    card = mod_card;
-                }
-            }
-        }
+        arrange_mode = ARRANGE_ROW;
     } else if (IsKeyPressed(KEY_V)) {
-        std::vector<Card> y_cards;
-        std::copy_if(cards.begin(), cards.end(), std::back_inserter(y_cards), [](auto& card){return card.selected;});
-        std::sort(y_cards.begin(), y_cards.end(), [](auto& card1, auto& card2) {
-            return card1.body_rect.y < card2.body_rect.y;
-        });
-        float move = 0;
-        for (auto &card: y_cards) {
-            card.lock_target = {position.x, position.y + move};
-            move += card.body_rect.height;
-        }
-        for (auto &card: cards) {
-            for (auto &mod_card: y_cards) {
-                if (card == mod_card) {
-                    card = mod_card;
-                }
-            }
-        }
+        arrange_mode = ARRANGE_COLUMN;
     } else if (IsKeyPressed(KEY_C)) {
-        std::vector<Card> selected_cards;
-        std::copy_if(cards.begin(), cards.end(), std::back_inserter(selected_cards), [](auto& card){return card.selected;});
-        std::sort(selected_cards.begin(), selected_cards.end(), [](auto& card1, auto& card2) {
-            return card1.depth < card2.depth;
-        });
-        for (auto &card: selected_cards) {
-            card.lock_target = {position.x, position.y};
-        }
+        arrange_mode = ARRANGE_STACK;
+    } else if (IsKeyPressed(KEY_G)) {
+        arrange_mode = ARRANGE_GRID;
+    } else if (IsKeyPressed(KEY_T)) {
+        arrange_mode = ARRANGE_TIMELINE;
+    } else {
+        arrange = false;
+    }
+    if (arrange) {
         for (auto &card: cards) {
-            for (auto &mod_card: selected_cards) {
-                if (card == mod_card) {
-                    card = mod_card;
-                }
-            }
+            if (card.selected) watch_card_position(player.undo, card);
         }
+        arrange_selected_cards(cards, arrange_mode, position);
+        record_card_moves(player.undo, cards);
     }
 }
 
-void player_grabbing_update(Player& player, std::vector<Card>& cards) {
+void player_grabbing_update(Player& player, CardPool& cards) {
     if (IsMouseButtonReleased(0)) {
         player.hold_diff = {0, 0};
         player.selection_rec = {0};
+        player.selection_world_rec = {0};
         player.state = HOVERING;
         return;
     }
@@ -491,8 +590,25 @@ void player_grabbing_update(Player& player, std::vector<Card>& cards) {
     auto world_coords = GetScreenToWorld2D((Vector2) {player.selection_rec.x, player.selection_rec.y}, player.camera);
     auto world_size = (Vector2) {player.selection_rec.width, player.selection_rec.height} * (1.0/player.camera.zoom);
     Rectangle selected_world_rect = {world_coords.x, world_coords.y, world_size.x, world_size.y};
-    for (auto &card: cards) {
-        card.selected = collide(card.body_rect, selected_world_rect);
+
+    // Anything selected last frame lies inside last frame's rect, so looking at both covers every card whose selection can change.
+    Rectangle last_world_rect = player.selection_world_rec;
+    Rectangle search_rect = selected_world_rect;
+    if (last_world_rect.width > 0 || last_world_rect.height > 0) {
+        search_rect.x = fminf(selected_world_rect.x, last_world_rect.x);
+        search_rect.y = fminf(selected_world_rect.y, last_world_rect.y);
+        search_rect.width = fmaxf(selected_world_rect.x + selected_world_rect.width, last_world_rect.x + last_world_rect.width) - search_rect.x;
+        search_rect.height = fmaxf(selected_world_rect.y + selected_world_rect.height, last_world_rect.y + last_world_rect.height) - search_rect.y;
+    }
+    player.selection_world_rec = selected_world_rect;
+
+    static std::vector<int> nearby_cards;
+    nearby_cards.clear();
+    query_spatial_grid(card_grid, search_rect, nearby_cards);
+    for (auto index: nearby_cards) {
+        if (!slot_is_live(cards, index)) continue;
+        auto &card = pool_card(cards, index);
+        set_card_selected(card, collide(card.body_rect, selected_world_rect));
     }
 }
 
@@ -546,10 +662,11 @@ void player_write_big_picture_update(Player &player, Project &project) {
     return;
 }
 
-void player_select_scene_card_update(Player& player, std::vector<Card>& cards) {
-    if (player.selected_card == NULL) return;
+void player_select_scene_card_update(Player& player, CardPool& cards) {
+    Card *selected_card = get_card(cards, player.selected_card);
+    if (selected_card == NULL) return;
     if (IsKeyPressed(KEY_ESCAPE)) {
-        player.selected_card = NULL;
+        player.selected_card = NO_CARD;
         player.state = HOVERING;
         player.is_card_type_focus = false;
         return;
@@ -558,32 +675,26 @@ void player_select_scene_card_update(Player& player, std::vector<Card>& cards) {
     auto position = GetScreenToWorld2D(mouse_position, player.camera);
 
     if (IsMouseButtonPressed(0)) {
-        Card *player_card_over = &cards[0]; // Card that the player is hovering over
-        bool found_card = NULL;
-        for (auto &card: cards) {
-            if (CheckCollisionPointRec(position, card.body_rect)) {
-                found_card = true;
-                if (card.depth < player_card_over->depth && CheckCollisionPointRec(position, player_card_over->body_rect)) {
-                    continue;
-                }
-                player_card_over = &card;
-            }
-        }
-
+        Card *player_card_over = card_at(cards, position); // Card that the player is hovering over
         if (!player_card_over) return;
         Defer {player.is_card_type_focus = false;};
         if (player_card_over->type != SCENE) {
-            player.selected_card = NULL;
+            player.selected_card = NO_CARD;
             player.state = HOVERING;
             return;
         }
 
+        // The copy put under the card has to have everything, since lazy cards are only read in from the board.
+        load_lazy_card(*player_card_over);
         player_card_over->saved_dimensions.x = player_card_over->body_rect.width;
         player_card_over->saved_dimensions.y = player_card_over->body_rect.height;
         player_card_over->parent = player.selected_card;
-        player.selected_card->cards_under.push_back(*player_card_over);
-        player_card_over->deleted = true;
-        player.selected_card = NULL;
+        selected_card->cards_under.push_back(*player_card_over);
+        selected_card->cards_under.back().slot = -1;
+        mark_card_edited(*selected_card);
+        record_scene_insert(player.undo, *selected_card, selected_card->cards_under.size() - 1, *player_card_over);
+        set_card_deleted(*player_card_over, true);
+        player.selected_card = NO_CARD;
         player.state = HOVERING;
     }
 
@@ -598,20 +709,24 @@ void vec_move(std::vector<T>& v, size_t old_index, size_t new_index) {
     }
 }
 
-void player_drawer_select_card_update(Player& player, Drawer& drawer, std::vector<Card>& cards) {
+void player_drawer_select_card_update(Player& player, Drawer& drawer, CardPool& cards) {
     if (IsKeyPressed(KEY_ESCAPE)) {
-        player.selected_card = NULL;
+        player.selected_card = NO_CARD;
         player.state = HOVERING;
         drawer.open = false;
-        drawer.cards = NULL;
+        drawer.owner = NO_CARD;
         return;
     }
 
     auto mouse_position = GetMousePosition();
     auto position = GetScreenToWorld2D(mouse_position, player.camera);
 
+    Card *selected_card = get_card(cards, player.selected_card);
+    auto drawer_cards = get_drawer_cards(drawer, cards);
+    if (selected_card == NULL || drawer_cards == NULL) return;
+
     Card *hovering_card = NULL;
-    for (auto &card: *drawer.cards) {
+    for (auto &card: *drawer_cards) {
         update_button_hover(card.move_up_button, mouse_position);
         update_button_hover(card.move_down_button, mouse_position);
         update_button_hover(card.remove_from_drawer_button, mouse_position);
@@ -623,25 +738,36 @@ void player_drawer_select_card_update(Player& player, Drawer& drawer, std::vecto
 
     if (IsMouseButtonPressed(0)) {
         if (hovering_card->remove_from_drawer_button.hover) {
+            Card under = *hovering_card;
+            int under_index = hovering_card - drawer_cards->data();
             hovering_card->in_drawer = false;
-            hovering_card->parent = NULL;
+            hovering_card->parent = NO_CARD;
             hovering_card->body_rect.width = hovering_card->saved_dimensions.x + GRIDSIZE / 2;
             hovering_card->body_rect.height = hovering_card->saved_dimensions.y + GRIDSIZE / 2;
-            hovering_card->lock_target.x = player.selected_card->body_rect.x;
-            hovering_card->lock_target.y = player.selected_card->body_rect.y;
-            hovering_card->depth = player.selected_card->depth + 3;
+            hovering_card->lock_target.x = selected_card->body_rect.x;
+            hovering_card->lock_target.y = selected_card->body_rect.y;
+            hovering_card->depth = selected_card->depth + 3;
             Card new_card = (*hovering_card);
-            player.selected_card->cards_under.erase(std::remove(player.selected_card->cards_under.begin(), player.selected_card->cards_under.end(), *hovering_card), player.selected_card->cards_under.end());
-            cards.push_back(new_card);
+            selected_card->cards_under.erase(std::remove(selected_card->cards_under.begin(), selected_card->cards_under.end(), new_card), selected_card->cards_under.end());
+            mark_card_edited(*selected_card);
+            new_card.handle = NO_CARD;
+            acquire_card_handle(new_card);
+            record_scene_remove(player.undo, *selected_card, under_index, under, new_card);
+            add_card(cards, new_card);
+
             return;
         } else if (hovering_card->move_up_button.hover) {
-            size_t index = std::find(drawer.cards->begin(), drawer.cards->end(), *hovering_card) - drawer.cards->begin();
+            size_t index = std::find(drawer_cards->begin(), drawer_cards->end(), *hovering_card) - drawer_cards->begin();
             if (index == 0) return;
-            vec_move(*drawer.cards, index, index - 1);
+            vec_move(*drawer_cards, index, index - 1);
+            mark_card_edited(*selected_card);
+            record_scene_move(player.undo, *selected_card, index, index - 1);
         } else if (hovering_card->move_down_button.hover) {
-            size_t index = std::find(drawer.cards->begin(), drawer.cards->end(), *hovering_card) - drawer.cards->begin();
-            if (index == drawer.cards->size() - 1) return;
-            vec_move(*drawer.cards, index, index + 1);
+            size_t index = std::find(drawer_cards->begin(), drawer_cards->end(), *hovering_card) - drawer_cards->begin();
+            if (index == drawer_cards->size() - 1) return;
+            vec_move(*drawer_cards, index, index + 1);
+            mark_card_edited(*selected_card);
+            record_scene_move(player.undo, *selected_card, index, index + 1);
         }
     }
 }
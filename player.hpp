@@ -5,6 +5,8 @@
 #include "drawer.hpp"
 #include "main_menu.hpp"
 #include "search_box.hpp"
+#include "text_buffer.hpp"
+#include "undo.hpp"
 
 enum PlayerState {
     HOVERING, // Just looking, but still able to move cards around and such
@@ -54,21 +56,33 @@ struct Player {
     Vector2 hold_origin;
     Vector2 hold_diff;
     Rectangle selection_rec;
+    Rectangle selection_world_rec; // selection_rec in world space as of the last frame
 
-    Card *selected_card;
+    CardHandle selected_card;
+    CardHandle hovered_card; // Card last marked as hovered
     Vector2 offset;
     bool resizing_card;
+
+    // What's being written while WRITING. Loaded from the card when writing starts, and copied back to it once a
+    // frame if it was edited.
+    TextBuffer text;
+    CardHandle text_card;
+    WhichEdit text_field;
+    unsigned int text_revision; // Of the card when the buffer last matched it
+
+    UndoStack undo;
 };
 
 Player init_player();
 void player_update_camera(Player &player, bool allow_key_scroll = true);
-void player_write_update(Player& player);
+void player_write_update(Player& player, CardPool& cards);
+const TextBuffer* player_text_on(const Player& player, const Card& card);
 void player_search_update(Player& player, SearchBox& box);
-void player_resize_chosen_card(Player& player);
-void player_hover_update(Player& player, std::vector<Card>& cards, Palette& palette, Project &project, Drawer& drawer, MainMenu &menu, SearchBox& searchbox);
-void player_grabbing_update(Player& player, std::vector<Card>& cards);
+void player_resize_chosen_card(Player& player, CardPool& cards);
+void player_hover_update(Player& player, CardPool& cards, Palette& palette, Project &project, Drawer& drawer, MainMenu &menu, SearchBox& searchbox);
+void player_grabbing_update(Player& player, CardPool& cards);
 void player_write_big_picture_update(Player &player, Project &project);
 void player_write_palette_update(Player& player, Palette &palette);
 void player_write_focus_update(Player& player, Project& project);
-void player_select_scene_card_update(Player& player, std::vector<Card>& cards);
-void player_drawer_select_card_update(Player& player, Drawer& drawer, std::vector<Card>& cards);
+void player_select_scene_card_update(Player& player, CardPool& cards);
+void player_drawer_select_card_update(Player& player, Drawer& drawer, CardPool& cards);
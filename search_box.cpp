@@ -1,15 +1,13 @@
 #include "search_box.hpp"
 #include "common.hpp"
 #include "card.hpp"
+#include "card_pool.hpp"
+#include "search_index.hpp"
+#include "thread_pool.hpp"
 #include <cstring>
 #include <iterator>
 #include <sstream>
 
-#define FTS_FUZZY_MATCH_IMPLEMENTATION
-#include "fuzzy_match.hpp"
-
-using fts::fuzzy_match;
-
 SearchBox init_search_box() {
     SearchBox box;
     box.visible = false;
@@ -17,44 +15,33 @@ SearchBox init_search_box() {
     box.search_box = {30, 30, 30, 30};
     box.search = "";
     box.search_confirm = init_button();
-    box.results = std::vector<Card>();
+    box.results = std::vector<SearchResult>();
+    box.max_results = SEARCH_BOX_MAX_RESULTS;
+    box.parallel = true;
+    box.index = init_search_index();
     box.close = init_button();
     return box;
 }
 
-void update_search_box(SearchBox& box, std::vector<Card>& cards) {
+// Only searches again when the query changes.
+void update_search_box(SearchBox& box, CardPool& cards) {
     if (!box.visible) return;
-    for (auto& card: cards) card.selected = false;
-    if (box.search.empty()) return;
-    box.results.clear();
-    std::copy_if(cards.begin(), cards.end(), std::back_inserter(box.results), [&](auto &card) {
-        int amount = 0;
-        bool result = fuzzy_match(to_c_str(box.search).data(), to_c_str(card.content).data(), amount);
-        if (!card.cards_under.empty()) {
-            std::copy_if(card.cards_under.begin(), card.cards_under.end(), std::back_inserter(box.results), [&](auto &card) {
-                int amount_inner = 0;
-                bool result_inner = fuzzy_match(to_c_str(box.search).data(), to_c_str(card.content).data(), amount_inner);
-                return amount_inner > 0 && result_inner;
-            });
-        }
-        return amount > 0 && result;
-    });
-    std::sort(box.results.begin(), box.results.end(), [&](auto &result1, auto &result2) {
-        int score1 = 0;
-        int score2 = 0;
-        fuzzy_match(to_c_str(box.search).data(), to_c_str(result1.content).data(), score1);
-        fuzzy_match(to_c_str(box.search).data(), to_c_str(result2.content).data(), score2);
-        return score1 > score2;
-    });
-
-    for (auto& result: box.results) {
-        result.selected = true;
+    if (box.search == box.index.last_query) return;
+    for (auto& card: cards) set_card_selected(card, false);
+    if (box.search.empty()) {
+        box.index.last_query.clear();
+        return;
     }
-    for (auto& card: cards) {
-        for (auto& result: box.results) {
-            if (result == card) card = result;
-        }
+    refresh_search_index(box.index, cards);
+    auto &matches = run_search_query(box.index, box.search, box.parallel ? &worker_pool : NULL, box.max_results);
+
+    for (auto &match: matches) {
+        auto &document = box.index.documents[match.document];
+        if (document.under_index != -1) continue;
+        Card *card = get_card(cards, document.card);
+        if (card) set_card_selected(*card, true);
     }
+    rank_search_matches(box.index, box.max_results, box.results);
 }
 
 std::string truncate(std::string str, size_t width, bool show_ellipsis=true) {
@@ -68,11 +55,14 @@ std::string truncate(std::string str, size_t width, bool show_ellipsis=true) {
     return str;
 }
 
-void draw_search_box(SearchBox& box) {
+void draw_search_box(SearchBox& box, CardPool& cards) {
     DrawRectangleRec(box.backdrop, RED);
     draw_text_bubble(true, box.search, to_vector(box.backdrop));
     int result_index = 1;
-    for (auto& result: box.results) {
+    for (auto& found: box.results) {
+        Card *card = search_result_card(found, cards);
+        if (card == NULL) continue;
+        auto &result = *card;
         Vector2 where = {0, (float) result_index * 60};
         auto text_width = MeasureTextEx(application_font_regular, truncate(result.content, 8).c_str(), FONTSIZE_REGULAR, 1.0).x;
         auto text_height = MeasureTextEx(application_font_regular, truncate(result.content, 8).c_str(), FONTSIZE_REGULAR, 1.0).y;
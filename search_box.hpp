@@ -1,18 +1,25 @@
 #pragma once
 #include "common.hpp"
 #include "card.hpp"
+#include "search_index.hpp"
+
+// Only this many results are ranked and listed. Every matching card on the board still gets selected.
+#define SEARCH_BOX_MAX_RESULTS 8
 
 struct SearchBox {
     bool visible;
     Rectangle backdrop;
     Rectangle search_box;
     std::string search;
-    std::vector<Card> results;
+    std::vector<SearchResult> results; // Best matches first, at most max_results of them
+    int max_results;
+    bool parallel; // Split big queries across worker_pool
+    SearchIndex index;
     Button search_confirm;
     Button close;
 };
 
     
 SearchBox init_search_box();
-void update_search_box(SearchBox& box, std::vector<Card>& cards);
-void draw_search_box(SearchBox& box);
+void update_search_box(SearchBox& box, CardPool& cards);
+void draw_search_box(SearchBox& box, CardPool& cards);
@@ -0,0 +1,456 @@
+#include "search_index.hpp"
+#include "card.hpp"
+#include "card_pool.hpp"
+#include "common.hpp"
+#include "serialization.hpp"
+#include <cstring>
+#include <sstream>
+
+#define FTS_FUZZY_MATCH_IMPLEMENTATION
+#include "fuzzy_match.hpp"
+
+using fts::fuzzy_match;
+
+static std::string fold_case(const std::string& text) {
+    std::string folded = text;
+    for (auto &c: folded) c = tolower((unsigned char) c);
+    return folded;
+}
+
+// One bit per letter and digit. Everything else shares the remaining bits, so a set bit only means one of
+// those characters might be there.
+static unsigned long long character_mask(const std::string& folded) {
+    unsigned long long mask = 0;
+    for (unsigned char c: folded) {
+        int bit;
+        if (c >= 'a' && c <= 'z') bit = c - 'a';
+        else if (c >= '0' && c <= '9') bit = 26 + c - '0';
+        else bit = 36 + c % 28;
+        mask |= 1ull << bit;
+    }
+    return mask;
+}
+
+// Every character of `pattern` appears in `text` in order. fuzzy_match can't match otherwise.
+// memchr skips ahead to each character, and it's vectorized in most C libraries.
+static bool is_subsequence(const std::string& pattern, const std::string& text) {
+    const char *at = text.data();
+    const char *end = at + text.size();
+    for (char c: pattern) {
+        at = (const char*) memchr(at, c, end - at);
+        if (at == NULL) return false;
+        at += 1;
+    }
+    return true;
+}
+
+SearchIndex init_search_index() {
+    SearchIndex index;
+    index.documents = std::vector<SearchDocument>();
+    index.free_documents = std::vector<int>();
+    index.by_id = std::unordered_map<std::string, int>();
+    index.by_word = std::map<std::string, std::vector<int>>();
+    index.stamp = 0;
+    index.changed = true;
+    index.last_query = "";
+    index.last_filter = {~0u, ~0u, std::vector<std::string>()};
+    index.last_text = "";
+    index.candidates = std::vector<int>();
+    index.matches = std::vector<SearchMatch>();
+    index.shards = std::vector<SearchShard>();
+    index.shard_best = std::vector<SearchMatch>();
+    index.shard_best_limit = 0;
+    index.shard_min_candidates = SEARCH_SHARD_MIN_CANDIDATES;
+    index.shards_per_thread = SEARCH_SHARDS_PER_THREAD;
+    return index;
+}
+
+// Bytes past ASCII count as letters so UTF-8 words stay in one piece.
+static bool is_word_character(unsigned char c) {
+    return isalnum(c) || c >= 128;
+}
+
+static void split_words(const std::string& folded, std::vector<std::string>& words) {
+    size_t start = 0;
+    while (start < folded.size()) {
+        while (start < folded.size() && !is_word_character(folded[start])) start++;
+        size_t end = start;
+        while (end < folded.size() && is_word_character(folded[end])) end++;
+        if (end > start) words.push_back(folded.substr(start, end - start));
+        start = end;
+    }
+}
+
+static void remove_posting(std::vector<int>& postings, int document) {
+    auto found = std::find(postings.begin(), postings.end(), document);
+    if (found == postings.end()) return;
+    *found = postings.back();
+    postings.pop_back();
+}
+
+// Files the document under the words in `words` it isn't under yet, and takes it out from under the ones it
+// no longer has. Both lists are sorted, so typing into a card only touches the word being typed.
+static void refile_words(SearchIndex& index, int document, std::vector<std::string>& words) {
+    auto &old_words = index.documents[document].words;
+    size_t i = 0, j = 0;
+    while (i < old_words.size() || j < words.size()) {
+        if (j == words.size() || (i < old_words.size() && old_words[i] < words[j])) {
+            auto found = index.by_word.find(old_words[i]);
+            remove_posting(found->second, document);
+            if (found->second.empty()) index.by_word.erase(found);
+            i++;
+        } else if (i == old_words.size() || words[j] < old_words[i]) {
+            index.by_word[words[j]].push_back(document);
+            j++;
+        } else {
+            i++;
+            j++;
+        }
+    }
+    std::swap(old_words, words);
+}
+
+static void unfile_document(SearchIndex& index, int document) {
+    static std::vector<std::string> no_words;
+    no_words.clear();
+    refile_words(index, document, no_words);
+    remove_posting(index.by_type[index.documents[document].type], document);
+    remove_posting(index.by_tone[index.documents[document].tone], document);
+}
+
+// Files every live document again from scratch. Cheaper than taking documents out one at a time when most of
+// the board went away at once.
+static void refile_all_documents(SearchIndex& index) {
+    index.by_word.clear();
+    for (auto &postings: index.by_type) postings.clear();
+    for (auto &postings: index.by_tone) postings.clear();
+    for (int i = 0; i < (int) index.documents.size(); i++) {
+        auto &document = index.documents[i];
+        if (!document.live) continue;
+        for (auto &word: document.words) index.by_word[word].push_back(i);
+        index.by_type[document.type].push_back(i);
+        index.by_tone[document.tone].push_back(i);
+    }
+}
+
+static int index_card(SearchIndex& index, const Card& card, CardHandle owner, int under_index, int owner_document) {
+    auto found = index.by_id.find(card.id);
+    if (found == index.by_id.end()) {
+        SearchDocument document;
+        document.id = card.id;
+        document.type = card.type;
+        document.tone = card.tone;
+        document.revision = card.content_revision + 1; // Anything but the card's, so the text gets copied below
+        document.owner = -1;
+        document.live = true;
+        int position = index.documents.size();
+        if (!index.free_documents.empty()) {
+            position = index.free_documents.back();
+            index.free_documents.pop_back();
+            index.documents[position] = document;
+        } else {
+            index.documents.push_back(document);
+        }
+        index.by_type[document.type].push_back(position);
+        index.by_tone[document.tone].push_back(position);
+        found = index.by_id.emplace(card.id, position).first;
+    }
+    int position = found->second;
+    auto &document = index.documents[position];
+    if (document.revision != card.content_revision) {
+        static std::vector<std::string> words;
+        document.text = card.content;
+        document.folded = fold_case(card.content);
+        document.letters = character_mask(document.folded);
+        words.clear();
+        split_words(fold_case(card.name), words);
+        split_words(document.folded, words);
+        std::sort(words.begin(), words.end());
+        words.erase(std::unique(words.begin(), words.end()), words.end());
+        refile_words(index, position, words);
+        if (document.type != card.type || document.tone != card.tone) {
+            remove_posting(index.by_type[document.type], position);
+            remove_posting(index.by_tone[document.tone], position);
+            document.type = card.type;
+            document.tone = card.tone;
+            index.by_type[document.type].push_back(position);
+            index.by_tone[document.tone].push_back(position);
+        }
+        document.revision = card.content_revision;
+        index.changed = true;
+    }
+    if (document.owner != owner_document) index.changed = true;
+    document.card = owner;
+    document.under_index = under_index;
+    document.owner = owner_document;
+    document.under.clear();
+    document.stamp = index.stamp;
+    return position;
+}
+
+// Brings the documents in line with the board. Only edited cards are copied and filed again.
+// Cards still waiting on their text are loaded, so the first search after a lazy load reads the whole save.
+void refresh_search_index(SearchIndex& index, CardPool& cards) {
+    index.stamp += 1;
+    for (auto &card: cards) {
+        load_lazy_card(card);
+        int document = index_card(index, card, card.handle, -1, -1);
+        for (int i = 0; i < (int) card.cards_under.size(); i++) {
+            int under = index_card(index, card.cards_under[i], card.handle, i, document);
+            index.documents[document].under.push_back(under);
+        }
+    }
+    // Drop the documents of cards that are gone.
+    static std::vector<int> gone;
+    gone.clear();
+    for (int i = 0; i < (int) index.documents.size(); i++) {
+        if (index.documents[i].live && index.documents[i].stamp != index.stamp) gone.push_back(i);
+    }
+    bool refile_all = gone.size() > 64 && gone.size() * 4 > index.documents.size();
+    for (auto i: gone) {
+        auto &document = index.documents[i];
+        if (!refile_all) unfile_document(index, i);
+        index.by_id.erase(document.id);
+        document = SearchDocument();
+        document.live = false;
+        index.free_documents.push_back(i);
+        index.changed = true;
+    }
+    if (refile_all) refile_all_documents(index);
+}
+
+static const char *type_names[] = {"period", "event", "scene", "legacy"};
+static const char *tone_names[] = {"light", "dark"};
+
+// Bit for every name `value` is the start of. An empty value allows everything.
+static unsigned int facet_bits(const std::string& value, const char **names, int name_count) {
+    unsigned int bits = 0;
+    for (int i = 0; i < name_count; i++) {
+        if (strncmp(names[i], value.c_str(), value.size()) == 0) bits |= 1u << i;
+    }
+    return bits;
+}
+
+static bool starts_with(const std::string& text, const std::string& prefix) {
+    return text.compare(0, prefix.size(), prefix) == 0;
+}
+
+// Splits `type:`, `tone:` and `event:` terms out of a query. What's left is the text to fuzzy match.
+void parse_search_query(const std::string& query, SearchFilter& filter, std::string& text) {
+    filter.types = ~0u;
+    filter.tones = ~0u;
+    filter.events.clear();
+    text.clear();
+    std::istringstream terms(query);
+    std::string term;
+    while (terms >> term) {
+        auto folded = fold_case(term);
+        if (starts_with(folded, "type:")) {
+            filter.types &= facet_bits(folded.substr(5), type_names, LEGACY + 1);
+        } else if (starts_with(folded, "tone:")) {
+            filter.tones &= facet_bits(folded.substr(5), tone_names, DARK + 1);
+        } else if (starts_with(folded, "event:")) {
+            std::vector<std::string> words;
+            split_words(folded.substr(6), words);
+            filter.events.insert(filter.events.end(), words.begin(), words.end());
+        } else {
+            if (!text.empty()) text += ' ';
+            text += term;
+        }
+    }
+}
+
+static bool same_filter(const SearchFilter& filter1, const SearchFilter& filter2) {
+    return filter1.types == filter2.types && filter1.tones == filter2.tones && filter1.events == filter2.events;
+}
+
+static bool has_facets(const SearchFilter& filter) {
+    const unsigned int all_types = (1u << (LEGACY + 1)) - 1;
+    const unsigned int all_tones = (1u << (DARK + 1)) - 1;
+    return (filter.types & all_types) != all_types || (filter.tones & all_tones) != all_tones || !filter.events.empty();
+}
+
+static bool has_word_starting_with(const SearchDocument& document, const std::string& prefix) {
+    auto found = std::lower_bound(document.words.begin(), document.words.end(), prefix);
+    return found != document.words.end() && starts_with(*found, prefix);
+}
+
+static bool passes_filter(const SearchIndex& index, const SearchDocument& document, const SearchFilter& filter) {
+    if (!(filter.types & (1u << document.type)) || !(filter.tones & (1u << document.tone))) return false;
+    for (auto &word: filter.events) {
+        if (document.owner == -1) return false;
+        auto &event = index.documents[document.owner];
+        if (event.type != EVENT || !has_word_starting_with(event, word)) return false;
+    }
+    return true;
+}
+
+// Documents tucked under an event with a word starting with `prefix`.
+static void collect_under_events(const SearchIndex& index, const std::string& prefix, std::vector<int>& out) {
+    for (auto word = index.by_word.lower_bound(prefix); word != index.by_word.end() && starts_with(word->first, prefix); ++word) {
+        for (auto document: word->second) {
+            auto &event = index.documents[document];
+            if (event.type == EVENT && event.owner == -1) out.insert(out.end(), event.under.begin(), event.under.end());
+        }
+    }
+    // An event with several words starting with the prefix was visited once for each of them.
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+// Sets `out` to every document passing `filter`, in document order. Only the shortest of the facets' lists is
+// walked, and the other facets are checked on the documents in it.
+static void filter_documents(const SearchIndex& index, const SearchFilter& filter, std::vector<int>& out) {
+    static std::vector<int> shortest;
+    static std::vector<int> listed;
+    out.clear();
+    bool any_facet = false;
+    auto consider = [&](std::vector<int>& list) {
+        if (!any_facet || list.size() < shortest.size()) std::swap(shortest, list);
+        any_facet = true;
+    };
+    if (!filter.events.empty()) {
+        listed.clear();
+        collect_under_events(index, filter.events[0], listed);
+        consider(listed);
+    }
+    const unsigned int all_types = (1u << (LEGACY + 1)) - 1;
+    if ((filter.types & all_types) != all_types) {
+        listed.clear();
+        for (int type = 0; type <= LEGACY; type++) {
+            if (filter.types & (1u << type)) listed.insert(listed.end(), index.by_type[type].begin(), index.by_type[type].end());
+        }
+        consider(listed);
+    }
+    const unsigned int all_tones = (1u << (DARK + 1)) - 1;
+    if ((filter.tones & all_tones) != all_tones) {
+        listed.clear();
+        for (int tone = 0; tone <= DARK; tone++) {
+            if (filter.tones & (1u << tone)) listed.insert(listed.end(), index.by_tone[tone].begin(), index.by_tone[tone].end());
+        }
+        consider(listed);
+    }
+
+    if (!any_facet) {
+        for (int i = 0; i < (int) index.documents.size(); i++) {
+            if (index.documents[i].live) out.push_back(i);
+        }
+        return;
+    }
+    for (auto document: shortest) {
+        if (passes_filter(index, index.documents[document], filter)) out.push_back(document);
+    }
+    std::sort(out.begin(), out.end());
+}
+
+static bool ranks_before(const SearchMatch& match1, const SearchMatch& match2) {
+    if (match1.score != match2.score) return match1.score > match2.score;
+    return match1.document < match2.document;
+}
+
+// Scores candidates [first, last) into `shard`. Only reads the index, so shards can be scored at the same time.
+// Documents missing one of the query's characters are thrown out by their masks before anything reads their text.
+static void score_candidates(const SearchIndex& index, const std::string& query, const std::string& folded_query,
+                             int first, int last, int limit, SearchShard& shard) {
+    shard.candidates.clear();
+    shard.matches.clear();
+    unsigned long long query_letters = character_mask(folded_query);
+    for (int i = first; i < last; i++) {
+        int document = index.candidates[i];
+        if (query_letters & ~index.documents[document].letters) continue;
+        if (!is_subsequence(folded_query, index.documents[document].folded)) continue;
+        shard.candidates.push_back(document);
+        int score = 0;
+        bool matched = fuzzy_match(query.c_str(), index.documents[document].text.c_str(), score);
+        if (matched && score > 0) shard.matches.push_back({document, score});
+    }
+    if (limit > 0) {
+        auto middle = shard.matches.begin() + std::min<size_t>(limit, shard.matches.size());
+        std::partial_sort(shard.matches.begin(), middle, shard.matches.end(), ranks_before);
+    }
+}
+
+// Facet terms pick the documents to look at, and the rest of the query is fuzzy matched against those. A query
+// of only facet terms matches every document passing them, with a score of 0.
+// Scores are computed once per document. If the new query just adds characters to the last one's text, only
+// the last query's candidates are looked at.
+// With a pool, big queries are split into shards that are scored on its threads. Each shard also ranks its own
+// best `limit` matches, so rank_search_matches only has to merge those.
+const std::vector<SearchMatch>& run_search_query(SearchIndex& index, const std::string& query, ThreadPool* pool, int limit) {
+    if (!index.changed && query == index.last_query) return index.matches;
+    SearchFilter filter;
+    std::string text;
+    parse_search_query(query, filter, text);
+    bool narrowing = !index.changed && !index.last_query.empty() && same_filter(filter, index.last_filter) &&
+        text.size() > index.last_text.size() && starts_with(text, index.last_text);
+    auto folded_text = fold_case(text);
+
+    if (!narrowing) filter_documents(index, filter, index.candidates);
+
+    index.matches.clear();
+    index.shard_best.clear();
+    index.shard_best_limit = 0;
+    int candidate_count = index.candidates.size();
+    int shard_count = 1;
+    if (pool) {
+        shard_count = std::min(thread_pool_size(*pool) * index.shards_per_thread, candidate_count / index.shard_min_candidates);
+        shard_count = std::max(shard_count, 1);
+    }
+
+    if (text.empty() && !has_facets(filter)) {
+        // Matches nothing, but the candidates stay every document, so the next query can still narrow them down.
+    } else if (text.empty()) {
+        for (auto document: index.candidates) index.matches.push_back({document, 0});
+    } else if (shard_count == 1) {
+        if (index.shards.empty()) index.shards.emplace_back();
+        score_candidates(index, text, folded_text, 0, candidate_count, 0, index.shards[0]);
+        std::swap(index.candidates, index.shards[0].candidates);
+        std::swap(index.matches, index.shards[0].matches);
+    } else {
+        if ((int) index.shards.size() < shard_count) index.shards.resize(shard_count);
+        run_on_thread_pool(*pool, shard_count, [&](int shard) {
+            int first = (long long) candidate_count * shard / shard_count;
+            int last = (long long) candidate_count * (shard + 1) / shard_count;
+            score_candidates(index, text, folded_text, first, last, limit, index.shards[shard]);
+        });
+        // Shards are in candidate order, so joining them keeps the candidates in document order.
+        index.candidates.clear();
+        for (int i = 0; i < shard_count; i++) {
+            auto &shard = index.shards[i];
+            index.candidates.insert(index.candidates.end(), shard.candidates.begin(), shard.candidates.end());
+            index.matches.insert(index.matches.end(), shard.matches.begin(), shard.matches.end());
+            if (limit > 0) {
+                auto best_end = shard.matches.begin() + std::min<size_t>(limit, shard.matches.size());
+                index.shard_best.insert(index.shard_best.end(), shard.matches.begin(), best_end);
+            }
+        }
+        index.shard_best_limit = limit;
+    }
+    index.last_query = query;
+    index.last_filter = filter;
+    index.last_text = text;
+    index.changed = false;
+    return index.matches;
+}
+
+// The best `limit` matches of the last query, best first. Only those are sorted. If the query was split into
+// shards that each kept at least that many of their best, the overall best are among those.
+void rank_search_matches(const SearchIndex& index, int limit, std::vector<SearchResult>& results) {
+    static std::vector<SearchMatch> best;
+    auto &from = limit <= index.shard_best_limit ? index.shard_best : index.matches;
+    best.resize(std::min<size_t>(limit, from.size()));
+    std::partial_sort_copy(from.begin(), from.end(), best.begin(), best.end(), ranks_before);
+    results.clear();
+    for (auto &match: best) {
+        auto &document = index.documents[match.document];
+        results.push_back({match.score, document.card, document.under_index});
+    }
+}
+
+// The card a result was made from, or NULL if it's gone.
+Card* search_result_card(const SearchResult& result, CardPool& cards) {
+    Card *card = get_card(cards, result.card);
+    if (card == NULL || result.under_index == -1) return card;
+    if (result.under_index >= (int) card->cards_under.size()) return NULL;
+    return &card->cards_under[result.under_index];
+}
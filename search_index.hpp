@@ -0,0 +1,93 @@
+#pragma once
+#include "common.hpp"
+#include "card.hpp"
+#include "thread_pool.hpp"
+#include <map>
+#include <unordered_map>
+
+// A query is only split across threads once it has this many candidates per piece. tests/search_bench.cpp
+// measures waking the workers against scoring a candidate; the wake was under a candidate's worth on the
+// machines it's been run on, so this is a conservative floor rather than a break-even point.
+#define SEARCH_SHARD_MIN_CANDIDATES 128
+// Pieces per thread, so a thread that gets the long cards doesn't hold up the rest. Also swept by the benchmark,
+// but it needs more than one core to show anything.
+#define SEARCH_SHARDS_PER_THREAD 4
+
+// What the search sees of one card, on the board or tucked under one.
+struct SearchDocument {
+    std::string id;
+    std::string text;   // Copy of the card's content
+    std::string folded; // `text` lowercased, for rejecting cards without calling fuzzy_match
+    unsigned long long letters; // character_mask of `folded`
+    std::vector<std::string> words; // Distinct lowercased words of the card's name and content, sorted
+    CardType type;
+    Tone tone;
+    unsigned int revision; // Card::content_revision the copies were made at
+    CardHandle card;    // The board card, or the card this one is tucked under
+    int under_index;    // -1 for a board card, otherwise its place in the owner's cards_under
+    int owner;          // Document of the card this one is tucked under, or -1
+    std::vector<int> under; // Documents of the cards tucked under this one
+    unsigned int stamp; // Last refresh the card was still around for
+    bool live;          // Documents of cards that are gone are kept for the next new card
+};
+
+// The facet terms of a query, like `type:scene tone:dark event:dragon`. Values may be cut short, since they're
+// looked at while they're being typed.
+struct SearchFilter {
+    unsigned int types; // Bit per CardType a match can have
+    unsigned int tones; // Bit per Tone
+    std::vector<std::string> events; // Every one of these starts a word of the event the match is under
+};
+
+struct SearchMatch {
+    int document;
+    int score;
+};
+
+// What one thread made of its piece of the candidates.
+struct SearchShard {
+    std::vector<int> candidates;
+    std::vector<SearchMatch> matches; // Best `limit` first when the query was run with one
+};
+
+// A ranked match that stays valid after the index changes. Cards under other cards have no handle of their own,
+// so those are found through the card they're under.
+struct SearchResult {
+    int score;
+    CardHandle card;   // The board card, or the card the match is tucked under
+    int under_index;   // -1 for a board card, otherwise its place in the owner's cards_under
+};
+
+// Keeps a copy of every card's text so a query doesn't have to walk the cards, and remembers which documents
+// could match the last query. Typing another character can only narrow those down, so the next query only
+// looks at them.
+// Documents are also filed by word, type and tone, so facet terms are answered from those lists instead of by
+// looking at every document. Only the free text of a query is fuzzy matched.
+struct SearchIndex {
+    std::vector<SearchDocument> documents; // Indices stay put while the card is around
+    std::vector<int> free_documents;
+    std::unordered_map<std::string, int> by_id;
+    std::map<std::string, std::vector<int>> by_word; // Ordered, so every word with a prefix is one range
+    std::vector<int> by_type[LEGACY + 1];
+    std::vector<int> by_tone[DARK + 1];
+    unsigned int stamp;
+    bool changed; // Documents were added, dropped, moved or edited since the last query
+
+    std::string last_query;
+    SearchFilter last_filter;
+    std::string last_text; // last_query without its facet terms
+    std::vector<int> candidates; // Documents passing last_filter and containing every character of last_text in order
+    std::vector<SearchMatch> matches; // What last_query matched, in no particular order
+    std::vector<SearchShard> shards;
+    std::vector<SearchMatch> shard_best; // Every shard's best shard_best_limit matches
+    int shard_best_limit; // 0 when the last query wasn't split up
+    int shard_min_candidates; // SEARCH_SHARD_MIN_CANDIDATES, unless a benchmark is trying other values
+    int shards_per_thread;    // SEARCH_SHARDS_PER_THREAD, likewise
+};
+
+SearchIndex init_search_index();
+void parse_search_query(const std::string& query, SearchFilter& filter, std::string& text);
+void refresh_search_index(SearchIndex& index, CardPool& cards);
+const std::vector<SearchMatch>& run_search_query(SearchIndex& index, const std::string& query, ThreadPool* pool = NULL, int limit = 0);
+void rank_search_matches(const SearchIndex& index, int limit, std::vector<SearchResult>& results);
+Card* search_result_card(const SearchResult& result, CardPool& cards);
@@ -1,8 +1,15 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <ostream>
 #include "json.hpp"
 #include "common.hpp"
 #include "card.hpp"
+#include "card_pool.hpp"
+#include "json_writer.hpp"
+#include "journal.hpp"
+#include "mapped_file.hpp"
 #include "serialization.hpp"
 
 using json = nlohmann::json;
@@ -12,113 +19,736 @@ struct CardToFind {
     std::string id;
 };
 
-void load_cards(std::vector<Card>& cards, const char *filename) {
-    //std::vector<Card> cards;
-    std::ifstream file(filename);
-    std::string content;
-    Card current_card = init_card("", {0, 0, GRIDSIZE * 17, GRIDSIZE * 13});
-    json j;
-    file >> j;
-    for (auto &card: j["cards"]) {
-        Defer {current_card = init_card("", {0, 0, GRIDSIZE * 17, GRIDSIZE * 13});};
-        current_card.id = card.at("id");
-        current_card.type = card.at("type");
-        current_card.tone = card.at("tone");
-        current_card.body_rect.x = card.at("x");
-        current_card.body_rect.y = card.at("y");
-        current_card.lock_target.x = card.at("x");
-        current_card.lock_target.y = card.at("y");
-        current_card.body_rect.width = card.at("w");
-        current_card.body_rect.height = card.at("h");
-        current_card.content = card.at("content");
-        if (card.count("fontsize") > 0) {
-            current_card.fontsize = card.at("fontsize");
-            switch (current_card.fontsize) {
-            case SMALL: 
-                current_card.font = &application_font_small;
-                break;
-            case REGULAR: 
-                current_card.font = &application_font_regular;
-                break;
-            case LARGE: 
-                current_card.font = &application_font_large;
-                break;
-            }
+// What the JSON being read at some depth is. Anything the loader doesn't know is SKIPPED, along with
+// everything inside it.
+enum LoadContext {
+    LOAD_ROOT,
+    LOAD_CARDS,      // "cards", an array or, in older saves, an object keyed by position
+    LOAD_CARD,
+    LOAD_UNDER_LIST, // A card's "cards_under"
+    LOAD_UNDER_CARD,
+    LOAD_SKIPPED,
+};
+
+// Fills in cards as the parser reads them, and adds each one to the pool as soon as its object ends. Only the
+// card being read is ever held in memory.
+struct CardLoader : nlohmann::json_sax<json> {
+    CardPool *cards;
+    Card blank; // Defaults every card starts from, so init_card only makes one UUID per load
+    Card card;
+    Card under_card;
+    std::vector<LoadContext> contexts;
+    std::string current_key;
+
+    LoadContext context() {
+        return contexts.empty() ? LOAD_SKIPPED : contexts.back();
+    }
+
+    LoadContext child_context() {
+        if (contexts.empty()) return LOAD_ROOT;
+        switch (contexts.back()) {
+        case LOAD_ROOT: return current_key == "cards" ? LOAD_CARDS : LOAD_SKIPPED;
+        case LOAD_CARDS: return LOAD_CARD;
+        case LOAD_CARD: return current_key == "cards_under" ? LOAD_UNDER_LIST : LOAD_SKIPPED;
+        case LOAD_UNDER_LIST: return LOAD_UNDER_CARD;
+        default: return LOAD_SKIPPED;
         }
-        if (card.count("cards_under") > 0) {
-            for (auto &under_card_json: card.at("cards_under")) {
-                auto under_card = init_card("", {0, 0, GRIDSIZE * 17, GRIDSIZE * 13});
-                under_card.parent = &current_card;
-                under_card.id = under_card_json.at("id");
-                under_card.type = under_card_json.at("type");
-                under_card.tone = under_card_json.at("tone");
-                under_card.content = under_card_json.at("content");
-                if (under_card_json.count("fontsize") > 0) {
-                    under_card.fontsize = under_card_json.at("fontsize");
-                    switch (under_card.fontsize) {
-                    case SMALL: 
-                        under_card.font = &application_font_small;
-                        break;
-                    case REGULAR: 
-                        under_card.font = &application_font_regular;
-                        break;
-                    case LARGE: 
-                        under_card.font = &application_font_large;
-                        break;
-                    }
-                }
-                under_card.saved_dimensions.x = under_card_json.at("saved_dimensions_x");
-                under_card.saved_dimensions.y = under_card_json.at("saved_dimensions_y");
-                current_card.cards_under.push_back(std::move(under_card));
-            }
+    }
+
+    void begin_container() {
+        auto child = child_context();
+        if (child == LOAD_CARD) {
+            card = blank;
+            touch_card_content(card);
+        } else if (child == LOAD_UNDER_CARD) {
+            under_card = blank;
+            touch_card_content(under_card);
+            under_card.parent = acquire_card_handle(card);
+        }
+        contexts.push_back(child);
+    }
+
+    void end_container() {
+        auto ended = context();
+        contexts.pop_back();
+        if (ended == LOAD_CARD) {
+            add_card(*cards, card);
+        } else if (ended == LOAD_UNDER_CARD) {
+            card.cards_under.push_back(std::move(under_card));
+        }
+    }
+
+    // Types, tones and font sizes index arrays elsewhere, so one out of range stops the load like a parse error.
+    bool number(double value) {
+        if (context() != LOAD_CARD && context() != LOAD_UNDER_CARD) return true;
+        if (current_key == "type" && !(value >= 0 && value <= LEGACY)) return false;
+        if (current_key == "tone" && !(value >= 0 && value <= DARK)) return false;
+        if (current_key == "fontsize" && !(value >= 0 && value <= LARGE)) return false;
+        if (context() == LOAD_CARD) {
+            if (current_key == "type") card.type = (CardType) value;
+            else if (current_key == "tone") card.tone = (Tone) value;
+            else if (current_key == "x") card.body_rect.x = card.lock_target.x = value;
+            else if (current_key == "y") card.body_rect.y = card.lock_target.y = value;
+            else if (current_key == "w") card.body_rect.width = value;
+            else if (current_key == "h") card.body_rect.height = value;
+            else if (current_key == "fontsize") set_card_fontsize(card, (FontSize) value);
+        } else if (context() == LOAD_UNDER_CARD) {
+            if (current_key == "type") under_card.type = (CardType) value;
+            else if (current_key == "tone") under_card.tone = (Tone) value;
+            else if (current_key == "fontsize") set_card_fontsize(under_card, (FontSize) value);
+            else if (current_key == "saved_dimensions_x") under_card.saved_dimensions.x = value;
+            else if (current_key == "saved_dimensions_y") under_card.saved_dimensions.y = value;
+        }
+        return true;
+    }
+
+    bool string(string_t& value) override {
+        if (context() == LOAD_CARD) {
+            if (current_key == "id") card.id = std::move(value);
+            else if (current_key == "content") card.content = std::move(value);
+        } else if (context() == LOAD_UNDER_CARD) {
+            if (current_key == "id") under_card.id = std::move(value);
+            else if (current_key == "content") under_card.content = std::move(value);
         }
-        if (card.count("is_beginning") > 0)
-            current_card.is_beginning = true;
-        if (card.count("is_end") > 0)
-            current_card.is_end = true;
-        cards.emplace_back(current_card);
-    }
-}
-
-void save_cards(const std::vector<Card>& cards, const char *savefile) {
-    std::ofstream file(savefile);
-    json save_file;
-    save_file["cards"] = {};
-    int id = 0;
-    for (auto &card: cards) {
-        save_file["cards"][std::to_string(id)] = {
-            {"id", card.id},
-            {"type", card.type},
-            {"tone", card.tone},
-            {"x", card.body_rect.x},
-            {"y", card.body_rect.y},
-            {"w", card.body_rect.width},
-            {"h", card.body_rect.height},
-            {"content", card.content},
-            {"fontsize", card.fontsize},
-        };
-        if (!card.cards_under.empty()) {
-            save_file["cards"][std::to_string(id)]["cards_under"] = {};
-            for (auto &under_card: card.cards_under) {
-                save_file["cards"][std::to_string(id)]["cards_under"].push_back(
-                    {
-                        {"id", under_card.id},
-                        {"type", under_card.type},
-                        {"tone", under_card.tone},
-                        {"content", under_card.content},
-                        {"fontsize", under_card.fontsize},
-                        {"saved_dimensions_x", under_card.saved_dimensions.x},
-                        {"saved_dimensions_y", under_card.saved_dimensions.y},
-                    }
-                    );
+        return true;
+    }
+
+    // Older saves only ever wrote these as true, and the old loader only checked they were there.
+    void flag() {
+        if (context() != LOAD_CARD) return;
+        if (current_key == "is_beginning") card.is_beginning = true;
+        else if (current_key == "is_end") card.is_end = true;
+    }
+
+    bool null() override { flag(); return true; }
+    bool boolean(bool) override { flag(); return true; }
+    bool number_integer(number_integer_t value) override { flag(); return number(value); }
+    bool number_unsigned(number_unsigned_t value) override { flag(); return number(value); }
+    bool number_float(number_float_t value, const string_t&) override { flag(); return number(value); }
+    bool binary(binary_t&) override { return true; }
+    bool key(string_t& value) override { current_key = std::move(value); return true; }
+    bool start_object(std::size_t) override { begin_container(); return true; }
+    bool end_object() override { end_container(); return true; }
+    bool start_array(std::size_t) override { begin_container(); return true; }
+    bool end_array() override { end_container(); return true; }
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) override { return false; }
+};
+
+// Streams the file through the parser instead of reading it into a json document first. Returns false if the
+// file couldn't be parsed; the cards read before the error are still added.
+// Binary saves are recognised by their first bytes and handed to load_cards_binary.
+static bool load_save_file(CardPool& cards, const char *filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) return false;
+    char magic[4] = {0};
+    file.read(magic, sizeof(magic));
+    if (file.gcount() == sizeof(magic) && memcmp(magic, BINARY_SAVE_MAGIC, sizeof(magic)) == 0) {
+        file.close();
+        return load_cards_binary(cards, filename, true);
+    }
+    file.clear();
+    file.seekg(0);
+    CardLoader loader;
+    loader.cards = &cards;
+    loader.blank = init_card("", {0, 0, GRIDSIZE * 17, GRIDSIZE * 13});
+    loader.card = loader.blank;
+    loader.under_card = loader.blank;
+    return json::sax_parse(file, &loader);
+}
+
+// Edits journaled since the save was last written are replayed on top of it. A journal without a save is
+// from a board that was never written in full, and replays onto an empty one.
+bool load_cards(CardPool& cards, const char *filename) {
+    bool loaded = load_save_file(cards, filename);
+    if (!loaded && FileExists(filename)) return false;
+    return replay_journal(cards, journal_filename(filename).c_str()) > 0 || loaded;
+}
+
+static void json_text(JsonWriter& writer, const SavedText& text) {
+    json_string(writer, text.data.get(), text.size);
+}
+
+// Cards are written to the stream as they're visited, so saving never holds more than one card's worth of JSON.
+// "cards" is an array in board order. Older saves have it as an object keyed by position, which loads the same.
+static void write_snapshot_json(const SaveSnapshot& snapshot, std::ostream& file) {
+    auto writer = init_json_writer(file);
+    json_begin_object(writer);
+    json_key(writer, "cards");
+    json_begin_array(writer);
+    for (auto &card: snapshot.cards) {
+        json_begin_object(writer);
+        json_key(writer, "id");
+        json_text(writer, card.id);
+        json_key(writer, "type");
+        json_int(writer, card.type);
+        json_key(writer, "tone");
+        json_int(writer, card.tone);
+        json_key(writer, "x");
+        json_float(writer, card.body_rect.x);
+        json_key(writer, "y");
+        json_float(writer, card.body_rect.y);
+        json_key(writer, "w");
+        json_float(writer, card.body_rect.width);
+        json_key(writer, "h");
+        json_float(writer, card.body_rect.height);
+        json_key(writer, "content");
+        json_text(writer, card.content);
+        json_key(writer, "fontsize");
+        json_int(writer, card.fontsize);
+        if (card.under_count > 0) {
+            json_key(writer, "cards_under");
+            json_begin_array(writer);
+            for (int i = card.first_under; i < card.first_under + card.under_count; i++) {
+                auto &under_card = snapshot.under[i];
+                json_begin_object(writer);
+                json_key(writer, "id");
+                json_text(writer, under_card.id);
+                json_key(writer, "type");
+                json_int(writer, under_card.type);
+                json_key(writer, "tone");
+                json_int(writer, under_card.tone);
+                json_key(writer, "content");
+                json_text(writer, under_card.content);
+                json_key(writer, "fontsize");
+                json_int(writer, under_card.fontsize);
+                json_key(writer, "saved_dimensions_x");
+                json_float(writer, under_card.saved_dimensions.x);
+                json_key(writer, "saved_dimensions_y");
+                json_float(writer, under_card.saved_dimensions.y);
+                json_end_object(writer);
             }
+            json_end_array(writer);
         }
-        if (card.is_beginning)
-            save_file["cards"][std::to_string(id)]["is_beginning"] = true;
-        if (card.is_end)
-            save_file["cards"][std::to_string(id)]["is_end"] = true;
-            
+        if (card.is_beginning) {
+            json_key(writer, "is_beginning");
+            json_bool(writer, true);
+        }
+        if (card.is_end) {
+            json_key(writer, "is_end");
+            json_bool(writer, true);
+        }
+        json_end_object(writer);
+    }
+    json_end_array(writer);
+    json_end_object(writer);
+    file << std::endl;
+}
+
+// Binary layout, all numbers little endian:
+//   header          "MSCB", u32 version, u32 string count, u32 card count, u32 under card count
+//   string offsets  u32 file offset of every string (version 2 on)
+//   strings         u32 byte length, then the bytes, for every string
+//   cards           BINARY_CARD_SIZE bytes each, in board order
+//   under cards     BINARY_UNDER_CARD_SIZE bytes each, every card's cards_under in a row
+// Records refer to their id and content by index into the strings, and a card's cards_under is a range of the
+// under cards. The offsets let a string be found without reading the ones before it, which is what lets
+// lazily loaded cards leave their text on disk.
+#define BINARY_HEADER_SIZE 20
+#define BINARY_CARD_SIZE 36     // id, content, type, tone, fontsize, flags, x, y, w, h, first under card, under card count
+#define BINARY_UNDER_CARD_SIZE 20 // id, content, type, tone, fontsize, unused, saved_dimensions x and y
+#define BINARY_CARD_BEGINNING 1
+#define BINARY_CARD_END 2
+
+static void write_u8(std::ostream& out, unsigned char value) {
+    out.put((char) value);
+}
+
+static void write_u32(std::ostream& out, uint32_t value) {
+    char bytes[4] = {(char) value, (char) (value >> 8), (char) (value >> 16), (char) (value >> 24)};
+    out.write(bytes, 4);
+}
+
+static void write_f32(std::ostream& out, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    write_u32(out, bits);
+}
+
+static void write_string(std::ostream& out, const SavedText& value) {
+    write_u32(out, value.size);
+    out.write(value.data.get(), value.size);
+}
+
+// Board card ids come first in the string table, so a lazy load only has to touch that part of the file. The
+// rest go out in the order the cards are visited: content, then id and content of every card under it.
+// Records can then work out their string indices without a lookup table.
+static void write_snapshot_binary(const SaveSnapshot& snapshot, std::ostream& file) {
+    uint32_t card_count = snapshot.cards.size();
+    uint32_t under_count = snapshot.under.size();
+    uint32_t string_count = (card_count + under_count) * 2;
+    file.write(BINARY_SAVE_MAGIC, 4);
+    write_u32(file, BINARY_SAVE_VERSION);
+    write_u32(file, string_count);
+    write_u32(file, card_count);
+    write_u32(file, under_count);
+
+    uint32_t offset = BINARY_HEADER_SIZE + string_count * 4;
+    for (auto &card: snapshot.cards) {
+        write_u32(file, offset);
+        offset += 4 + card.id.size;
+    }
+    for (auto &card: snapshot.cards) {
+        write_u32(file, offset);
+        offset += 4 + card.content.size;
+        for (int i = card.first_under; i < card.first_under + card.under_count; i++) {
+            write_u32(file, offset);
+            offset += 4 + snapshot.under[i].id.size;
+            write_u32(file, offset);
+            offset += 4 + snapshot.under[i].content.size;
+        }
+    }
+
+    for (auto &card: snapshot.cards) write_string(file, card.id);
+    for (auto &card: snapshot.cards) {
+        write_string(file, card.content);
+        for (int i = card.first_under; i < card.first_under + card.under_count; i++) {
+            write_string(file, snapshot.under[i].id);
+            write_string(file, snapshot.under[i].content);
+        }
+    }
+
+    uint32_t id = 0;
+    uint32_t string = card_count;
+    for (auto &card: snapshot.cards) {
+        write_u32(file, id);
+        write_u32(file, string);
+        write_u8(file, card.type);
+        write_u8(file, card.tone);
+        write_u8(file, card.fontsize);
+        write_u8(file, (card.is_beginning ? BINARY_CARD_BEGINNING : 0) | (card.is_end ? BINARY_CARD_END : 0));
+        write_f32(file, card.body_rect.x);
+        write_f32(file, card.body_rect.y);
+        write_f32(file, card.body_rect.width);
+        write_f32(file, card.body_rect.height);
+        write_u32(file, card.first_under);
+        write_u32(file, card.under_count);
         id += 1;
+        string += 1 + card.under_count * 2;
+    }
+
+    string = card_count;
+    for (auto &card: snapshot.cards) {
+        string += 1;
+        for (int i = card.first_under; i < card.first_under + card.under_count; i++) {
+            auto &under_card = snapshot.under[i];
+            write_u32(file, string);
+            write_u32(file, string + 1);
+            write_u8(file, under_card.type);
+            write_u8(file, under_card.tone);
+            write_u8(file, under_card.fontsize);
+            write_u8(file, 0);
+            write_f32(file, under_card.saved_dimensions.x);
+            write_f32(file, under_card.saved_dimensions.y);
+            string += 2;
+        }
+    }
+}
+
+static uint32_t peek_u32(const char *at) {
+    const unsigned char *bytes = (const unsigned char*) at;
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t) bytes[3] << 24);
+}
+
+static float peek_f32(const char *at) {
+    uint32_t bits = peek_u32(at);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Where one string of the string table is in the file.
+struct BinaryString {
+    const char *data;
+    uint32_t size;
+};
+
+// The sections of a binary save, pointing into its bytes.
+struct BinarySave {
+    const char *data;
+    size_t size;
+    uint32_t version;
+    uint32_t string_count;
+    uint32_t card_count;
+    uint32_t under_count;
+    const char *string_offsets; // NULL before version 2
+    std::vector<BinaryString> strings; // Only version 1, which has to be walked to find anything
+    const char *card_records;
+    const char *under_records;
+    MappedFile mapping; // Only for saves lazy cards are reading from
+};
+
+// Finds the sections and checks every record, without reading any strings of a version 2 save.
+static bool parse_binary_save(const char *data, size_t size, BinarySave& save) {
+    save.data = data;
+    save.size = size;
+    if (size < BINARY_HEADER_SIZE || memcmp(data, BINARY_SAVE_MAGIC, 4) != 0) return false;
+    save.version = peek_u32(data + 4);
+    save.string_count = peek_u32(data + 8);
+    save.card_count = peek_u32(data + 12);
+    save.under_count = peek_u32(data + 16);
+    if (save.version < 1 || save.version > BINARY_SAVE_VERSION) return false;
+
+    size_t at = BINARY_HEADER_SIZE;
+    save.string_offsets = NULL;
+    save.strings.clear();
+    if (save.version >= 2) {
+        if ((size - at) / 4 < save.string_count) return false;
+        save.string_offsets = data + at;
+        at += (size_t) save.string_count * 4;
+        // Strings sit between the offsets and the records, so the records come right after the last one.
+        if (save.string_count > 0) {
+            size_t last = peek_u32(save.string_offsets + (size_t) (save.string_count - 1) * 4);
+            if (last > size || size - last < 4 || size - last - 4 < peek_u32(data + last)) return false;
+            at = last + 4 + peek_u32(data + last);
+        }
+    } else {
+        for (uint32_t i = 0; i < save.string_count; i++) {
+            if (size - at < 4) return false;
+            uint32_t length = peek_u32(data + at);
+            if (size - at - 4 < length) return false;
+            save.strings.push_back({data + at + 4, length});
+            at += 4 + length;
+        }
     }
-    file << save_file << std::endl;
+    size_t records = (size_t) save.card_count * BINARY_CARD_SIZE + (size_t) save.under_count * BINARY_UNDER_CARD_SIZE;
+    if (size - at < records) return false;
+    save.card_records = data + at;
+    save.under_records = save.card_records + (size_t) save.card_count * BINARY_CARD_SIZE;
+
+    for (uint32_t i = 0; i < save.card_count + save.under_count; i++) {
+        bool under = i >= save.card_count;
+        const char *record = under ? save.under_records + (size_t) (i - save.card_count) * BINARY_UNDER_CARD_SIZE :
+            save.card_records + (size_t) i * BINARY_CARD_SIZE;
+        if (peek_u32(record) >= save.string_count || peek_u32(record + 4) >= save.string_count) return false;
+        const unsigned char *enums = (const unsigned char*) record + 8;
+        if (enums[0] > LEGACY || enums[1] > DARK || enums[2] > LARGE) return false;
+        if (!under) {
+            uint32_t first_under = peek_u32(record + 28);
+            uint32_t count = peek_u32(record + 32);
+            if (first_under > save.under_count || count > save.under_count - first_under) return false;
+        }
+    }
+    return true;
+}
+
+// Where string `index` is. False if a version 2 offset points somewhere it shouldn't.
+static bool find_binary_string(const BinarySave& save, uint32_t index, BinaryString& found) {
+    if (save.version < 2) {
+        found = save.strings[index];
+        return true;
+    }
+    size_t offset = peek_u32(save.string_offsets + (size_t) index * 4);
+    if (offset > save.size || save.size - offset < 4) return false;
+    found.size = peek_u32(save.data + offset);
+    found.data = save.data + offset + 4;
+    return save.size - offset - 4 >= found.size;
+}
+
+static bool binary_string(const BinarySave& save, uint32_t index, std::string& out) {
+    BinaryString found;
+    if (!find_binary_string(save, index, found)) return false;
+    out.assign(found.data, found.size);
+    return true;
+}
+
+// Checks the strings of card `record` can be found: only its id, or with `text` its content and the strings of
+// the cards under it too.
+static bool card_strings_valid(const BinarySave& save, uint32_t record, bool text) {
+    BinaryString found;
+    const char *at = save.card_records + (size_t) record * BINARY_CARD_SIZE;
+    if (!find_binary_string(save, peek_u32(at), found)) return false;
+    if (!text) return true;
+    if (!find_binary_string(save, peek_u32(at + 4), found)) return false;
+    uint32_t first_under = peek_u32(at + 28);
+    uint32_t count = peek_u32(at + 32);
+    for (uint32_t i = 0; i < count; i++) {
+        const char *under = save.under_records + (size_t) (first_under + i) * BINARY_UNDER_CARD_SIZE;
+        if (!find_binary_string(save, peek_u32(under), found)) return false;
+        if (!find_binary_string(save, peek_u32(under + 4), found)) return false;
+    }
+    return true;
+}
+
+// Everything of card `record` but its content and cards_under.
+static bool read_card_record(const BinarySave& save, uint32_t record, Card& card) {
+    const char *at = save.card_records + (size_t) record * BINARY_CARD_SIZE;
+    card.type = (CardType) at[8];
+    card.tone = (Tone) at[9];
+    set_card_fontsize(card, (FontSize) at[10]);
+    card.is_beginning = at[11] & BINARY_CARD_BEGINNING;
+    card.is_end = at[11] & BINARY_CARD_END;
+    card.body_rect.x = card.lock_target.x = peek_f32(at + 12);
+    card.body_rect.y = card.lock_target.y = peek_f32(at + 16);
+    card.body_rect.width = peek_f32(at + 20);
+    card.body_rect.height = peek_f32(at + 24);
+    return binary_string(save, peek_u32(at), card.id);
+}
+
+// The content and cards_under of card `record`. Cards under it start as copies of `blank`.
+static bool read_card_text(const BinarySave& save, uint32_t record, Card& card, const Card& blank) {
+    const char *at = save.card_records + (size_t) record * BINARY_CARD_SIZE;
+    if (!binary_string(save, peek_u32(at + 4), card.content)) return false;
+    touch_card_content(card);
+    uint32_t first_under = peek_u32(at + 28);
+    uint32_t count = peek_u32(at + 32);
+    card.cards_under.reserve(card.cards_under.size() + count);
+    for (uint32_t i = 0; i < count; i++) {
+        const char *under = save.under_records + (size_t) (first_under + i) * BINARY_UNDER_CARD_SIZE;
+        Card under_card = blank;
+        touch_card_content(under_card);
+        if (!binary_string(save, peek_u32(under), under_card.id)) return false;
+        if (!binary_string(save, peek_u32(under + 4), under_card.content)) return false;
+        under_card.type = (CardType) under[8];
+        under_card.tone = (Tone) under[9];
+        set_card_fontsize(under_card, (FontSize) under[10]);
+        under_card.saved_dimensions.x = peek_f32(under + 12);
+        under_card.saved_dimensions.y = peek_f32(under + 16);
+        card.cards_under.push_back(std::move(under_card));
+    }
+    return true;
+}
+
+// Saves lazy cards are reading from. They stay mapped until load_lazy_cards has read everything out of them,
+// since until then a lazy card can be anywhere in the pool, and after that until no snapshot uses their text.
+static std::vector<std::shared_ptr<BinarySave>> lazy_saves;
+
+static void free_lazy_save(BinarySave *save) {
+    unmap_file(save->mapping);
+    delete save;
+}
+
+static const Card& blank_card() {
+    static Card blank = init_card("", {0, 0, GRIDSIZE * 17, GRIDSIZE * 13});
+    return blank;
+}
+
+// Reads in the content and cards_under a lazily loaded card left in its save. A string that turns out to be
+// damaged is left empty.
+void load_lazy_card(Card& card) {
+    if (!card_is_lazy(card)) return;
+    auto &save = *lazy_saves[card.lazy.save];
+    card.lazy.save = -1;
+    // Cards put under this one before it was read go after the ones it had in the file.
+    std::vector<Card> added = std::move(card.cards_under);
+    card.cards_under.clear();
+    read_card_text(save, card.lazy.record, card, blank_card());
+    for (auto &under_card: card.cards_under) under_card.parent = acquire_card_handle(card);
+    for (auto &under_card: added) card.cards_under.push_back(std::move(under_card));
+    mark_card_edited(card);
+}
+
+void load_lazy_cards(CardPool& cards) {
+    if (lazy_saves.empty()) return;
+    for (auto &card: cards) load_lazy_card(card);
+    lazy_saves.clear();
+}
+
+// With `lazy`, a version 2 save is mapped instead of read, and cards only get their geometry and id. Their
+// content and cards_under are read by load_lazy_card the first time something needs them, so loading takes
+// time in proportion to the number of cards, not the amount of text.
+// The whole file is checked before anything is added, so a damaged file adds nothing.
+bool load_cards_binary(CardPool& cards, const char *filename, bool lazy) {
+    auto save = new BinarySave();
+    save->mapping = {NULL, 0, NULL};
+    std::vector<char> bytes;
+    if (lazy) {
+        if (!map_file(save->mapping, filename)) {
+            delete save;
+            return false;
+        }
+        if (save->mapping.size < BINARY_HEADER_SIZE || peek_u32(save->mapping.data + 4) < 2) {
+            // Nothing to gain over reading it, since every string has to be walked anyway.
+            unmap_file(save->mapping);
+            lazy = false;
+        }
+    }
+    if (!lazy) {
+        std::ifstream file(filename, std::ios::binary | std::ios::ate);
+        if (file) {
+            bytes.resize(file.tellg());
+            file.seekg(0);
+            file.read(bytes.data(), bytes.size());
+        }
+        if (!file) {
+            delete save;
+            return false;
+        }
+    }
+    const char *data = lazy ? save->mapping.data : bytes.data();
+    size_t size = lazy ? save->mapping.size : bytes.size();
+
+    bool valid = parse_binary_save(data, size, *save);
+    // Ids are read up front in either mode, and in an eager load all the text is too, so those are checked here.
+    for (uint32_t i = 0; valid && i < save->card_count; i++) {
+        valid = card_strings_valid(*save, i, !lazy);
+    }
+    if (!valid) {
+        unmap_file(save->mapping);
+        delete save;
+        return false;
+    }
+
+    if (lazy) lazy_saves.push_back(std::shared_ptr<BinarySave>(save, free_lazy_save));
+    Card card;
+    for (uint32_t i = 0; i < save->card_count; i++) {
+        card = blank_card();
+        touch_card_content(card);
+        read_card_record(*save, i, card);
+        if (lazy) {
+            card.lazy = {(int) lazy_saves.size() - 1, i};
+        } else {
+            read_card_text(*save, i, card, blank_card());
+            for (auto &under_card: card.cards_under) under_card.parent = acquire_card_handle(card);
+        }
+        add_card(cards, card);
+    }
+    if (!lazy) delete save;
+    return true;
+}
+
+static SavedText copy_text(const std::string& text) {
+    auto copy = std::make_shared<const std::string>(text);
+    return {std::shared_ptr<const char>(copy, copy->data()), copy->size()};
+}
+
+// Text inside a mapped save. A string that turns out to be damaged is saved empty, like load_lazy_card reads it.
+static SavedText mapped_text(const std::shared_ptr<BinarySave>& save, uint32_t index) {
+    BinaryString found;
+    if (!find_binary_string(*save, index, found)) return {NULL, 0};
+    return {std::shared_ptr<const char>(save, found.data), found.size};
+}
+
+// The id and content of `card`, copied only if `cached` doesn't already have them at the card's revision.
+// A lazy card's content is left in its save.
+static void snapshot_card_text(const Card& card, SnapshotText *cached, SavedCard& saved) {
+    SnapshotText fresh;
+    SnapshotText &text = cached ? *cached : fresh;
+    bool stale = !cached || !text.id.data || text.revision != card.content_revision || text.id.size != card.id.size() ||
+        memcmp(text.id.data.get(), card.id.data(), text.id.size) != 0;
+    if (stale) {
+        text.revision = card.content_revision;
+        text.id = copy_text(card.id);
+        if (card_is_lazy(card)) {
+            auto &save = lazy_saves[card.lazy.save];
+            text.content = mapped_text(save, peek_u32(save->card_records + (size_t) card.lazy.record * BINARY_CARD_SIZE + 4));
+        } else {
+            text.content = copy_text(card.content);
+        }
+    }
+    saved.id = text.id;
+    saved.content = text.content;
+}
+
+static SavedCard saved_under_card(const Card& under_card, SnapshotText *cached) {
+    SavedCard saved = {};
+    snapshot_card_text(under_card, cached, saved);
+    saved.type = under_card.type;
+    saved.tone = under_card.tone;
+    saved.fontsize = under_card.fontsize;
+    saved.saved_dimensions = under_card.saved_dimensions;
+    return saved;
+}
+
+// The cards a lazy card still has in its save, straight out of the mapping.
+static void snapshot_lazy_under_cards(const Card& card, SaveSnapshot& snapshot) {
+    auto &save = lazy_saves[card.lazy.save];
+    const char *at = save->card_records + (size_t) card.lazy.record * BINARY_CARD_SIZE;
+    uint32_t first_under = peek_u32(at + 28);
+    uint32_t count = peek_u32(at + 32);
+    for (uint32_t i = 0; i < count; i++) {
+        const char *under = save->under_records + (size_t) (first_under + i) * BINARY_UNDER_CARD_SIZE;
+        SavedCard saved = {};
+        saved.id = mapped_text(save, peek_u32(under));
+        saved.content = mapped_text(save, peek_u32(under + 4));
+        saved.type = (CardType) under[8];
+        saved.tone = (Tone) under[9];
+        saved.fontsize = (FontSize) under[10];
+        saved.saved_dimensions = {peek_f32(under + 12), peek_f32(under + 16)};
+        snapshot.under.push_back(saved);
+    }
+}
+
+// Copies what a save needs out of the board. With a cache, text that hasn't changed since the last snapshot is
+// shared with it rather than copied, which leaves little more than the card records to copy on a board that's
+// mostly unchanged. Lazy cards aren't read in: the snapshot keeps their save mapped instead.
+void take_save_snapshot(const CardPool& cards, SaveSnapshot& snapshot, SnapshotTextCache *cache) {
+    snapshot.cards.clear();
+    snapshot.under.clear();
+    snapshot.cards.reserve(cards.active_cards);
+    if (cache) {
+        cache->cards.resize(cards.capacity);
+        cache->cards_under.resize(cards.capacity);
+    }
+    for (int slot = 0; slot < cards.capacity; slot++) {
+        if (!slot_is_live(cards, slot)) {
+            // Let go of removed cards' text, or the cache would keep it alive until the slot is reused.
+            if (cache && cache->cards[slot].id.data) {
+                cache->cards[slot] = {};
+                cache->cards_under[slot].clear();
+            }
+            continue;
+        }
+        auto &card = pool_card(cards, slot);
+        SavedCard saved = {};
+        snapshot_card_text(card, cache ? &cache->cards[slot] : NULL, saved);
+        saved.type = card.type;
+        saved.tone = card.tone;
+        saved.fontsize = card.fontsize;
+        saved.is_beginning = card.is_beginning;
+        saved.is_end = card.is_end;
+        saved.body_rect = card.body_rect;
+        saved.first_under = snapshot.under.size();
+        if (card_is_lazy(card)) snapshot_lazy_under_cards(card, snapshot);
+        if (cache) cache->cards_under[slot].resize(card.cards_under.size());
+        for (size_t i = 0; i < card.cards_under.size(); i++) {
+            snapshot.under.push_back(saved_under_card(card.cards_under[i], cache ? &cache->cards_under[slot][i] : NULL));
+        }
+        saved.under_count = snapshot.under.size() - saved.first_under;
+        snapshot.cards.push_back(saved);
+    }
+}
+
+// Writes to a temporary file next to `filename` and renames it into place, so a save that fails or is cut
+// short leaves the last good file as it was. Touches nothing but the snapshot, so it's safe to call from any
+// thread.
+bool write_save_snapshot(const SaveSnapshot& snapshot, const char *filename, SaveFormat format) {
+    std::string temporary = std::string(filename) + ".tmp";
+    {
+        std::ofstream file(temporary, format == SAVE_BINARY ? std::ios::binary : std::ios::out);
+        if (!file) return false;
+        if (format == SAVE_BINARY) write_snapshot_binary(snapshot, file);
+        else write_snapshot_json(snapshot, file);
+        file.close();
+        if (!file) {
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+    if (std::rename(temporary.c_str(), filename) == 0) return true;
+    #ifdef _WIN32
+    // rename won't replace an existing file on Windows.
+    std::remove(filename);
+    if (std::rename(temporary.c_str(), filename) == 0) return true;
+    #endif
+    std::remove(temporary.c_str());
+    return false;
+}
+
+// Saving the whole board makes its journal redundant, so that's emptied too.
+static bool save_cards_as(CardPool& cards, const char *savefile, SaveFormat format) {
+    // The file being replaced may be the one lazy cards are still reading from, which Windows won't allow.
+    load_lazy_cards(cards);
+    SaveSnapshot snapshot;
+    take_save_snapshot(cards, snapshot);
+    if (!write_save_snapshot(snapshot, savefile, format)) return false;
+    std::remove(journal_filename(savefile).c_str());
+    return true;
+}
+
+bool save_cards(CardPool& cards, const char *savefile) {
+    return save_cards_as(cards, savefile, SAVE_JSON);
+}
+
+bool save_cards_binary(CardPool& cards, const char *savefile) {
+    return save_cards_as(cards, savefile, SAVE_BINARY);
 }
@@ -1,6 +1,7 @@
 #pragma once
 #include "common.hpp"
 #include "card.hpp"
+#include <memory>
 
 enum FileCheck {
     CARDTYPE,
@@ -9,5 +10,68 @@ enum FileCheck {
     CARDCONTENT,
 };
 
-void load_cards(std::vector<Card>& cards, const char *filename = "save.json");
-void save_cards(const std::vector<Card>& cards, const char *savefile = "save.json");
+// Binary saves start with these four bytes, followed by the format version. See serialization.cpp for the layout.
+#define BINARY_SAVE_MAGIC "MSCB"
+#define BINARY_SAVE_VERSION 2
+
+enum SaveFormat {
+    SAVE_JSON,
+    SAVE_BINARY,
+};
+
+// Text a snapshot shares with whatever it came from: a copy of a card's string, or the bytes of a mapped save
+// that lazy cards are still reading from. Either way it stays alive as long as the snapshot does.
+struct SavedText {
+    std::shared_ptr<const char> data;
+    size_t size;
+};
+
+// Everything a save file has of a card. Under cards only use id, content, type, tone, fontsize and
+// saved_dimensions.
+struct SavedCard {
+    SavedText id;
+    SavedText content;
+    CardType type;
+    Tone tone;
+    FontSize fontsize;
+    bool is_beginning;
+    bool is_end;
+    Rectangle body_rect;
+    Vector2 saved_dimensions;
+    int first_under; // Index into SaveSnapshot::under
+    int under_count;
+};
+
+// The board as it was when take_save_snapshot was called. It doesn't point at any card, so it can be written
+// out on another thread while the board keeps changing.
+struct SaveSnapshot {
+    std::vector<SavedCard> cards;
+    std::vector<SavedCard> under;
+};
+
+struct SnapshotText {
+    unsigned int revision; // The card's content_revision when the text was copied
+    SavedText id;
+    SavedText content;
+};
+
+// Text copied by earlier snapshots, by pool slot. Cards that haven't been edited since share their text with
+// the last snapshot instead of being copied again.
+struct SnapshotTextCache {
+    std::vector<SnapshotText> cards;
+    std::vector<std::vector<SnapshotText>> cards_under; // One per slot, in cards_under order
+};
+
+bool load_cards(CardPool& cards, const char *filename = "save.json");
+bool save_cards(CardPool& cards, const char *savefile = "save.json");
+bool load_cards_binary(CardPool& cards, const char *filename, bool lazy = false);
+bool save_cards_binary(CardPool& cards, const char *savefile);
+void load_lazy_card(Card& card);
+void load_lazy_cards(CardPool& cards);
+void take_save_snapshot(const CardPool& cards, SaveSnapshot& snapshot, SnapshotTextCache *cache = NULL);
+bool write_save_snapshot(const SaveSnapshot& snapshot, const char *filename, SaveFormat format);
+
+// The card was loaded lazily and its content and cards_under haven't been read yet.
+inline bool card_is_lazy(const Card& card) {
+    return card.lazy.save != -1;
+}
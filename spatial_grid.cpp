@@ -0,0 +1,114 @@
+#include "spatial_grid.hpp"
+#include "common.hpp"
+
+static long long cell_key(int x, int y) {
+    return ((long long) x << 32) ^ (long long) (unsigned int) y;
+}
+
+static CellRange cell_range(const SpatialGrid& grid, Rectangle rect) {
+    CellRange range;
+    range.min_x = (int) floorf(rect.x / grid.cell_size);
+    range.min_y = (int) floorf(rect.y / grid.cell_size);
+    range.max_x = (int) floorf((rect.x + rect.width) / grid.cell_size);
+    range.max_y = (int) floorf((rect.y + rect.height) / grid.cell_size);
+    range.active = true;
+    return range;
+}
+
+static bool operator==(const CellRange& r1, const CellRange& r2) {
+    return r1.active == r2.active && r1.min_x == r2.min_x && r1.min_y == r2.min_y && r1.max_x == r2.max_x && r1.max_y == r2.max_y;
+}
+
+static void file_key(SpatialGrid& grid, int key, const CellRange& range) {
+    for (int y = range.min_y; y <= range.max_y; y++) {
+        for (int x = range.min_x; x <= range.max_x; x++) {
+            grid.cells[cell_key(x, y)].push_back(key);
+        }
+    }
+}
+
+static void unfile_key(SpatialGrid& grid, int key, const CellRange& range) {
+    for (int y = range.min_y; y <= range.max_y; y++) {
+        for (int x = range.min_x; x <= range.max_x; x++) {
+            auto cell = grid.cells.find(cell_key(x, y));
+            if (cell == grid.cells.end()) continue;
+            auto& keys = cell->second;
+            auto found = std::find(keys.begin(), keys.end(), key);
+            if (found != keys.end()) {
+                *found = keys.back();
+                keys.pop_back();
+            }
+            if (keys.empty()) grid.cells.erase(cell);
+        }
+    }
+}
+
+SpatialGrid init_spatial_grid(float cell_size) {
+    SpatialGrid grid;
+    grid.cell_size = cell_size;
+    grid.cells = std::unordered_map<long long, std::vector<int>>();
+    grid.ranges = std::vector<CellRange>();
+    grid.stamps = std::vector<unsigned int>();
+    grid.current_stamp = 0;
+    return grid;
+}
+
+void clear_spatial_grid(SpatialGrid& grid) {
+    grid.cells.clear();
+    grid.ranges.clear();
+    grid.stamps.clear();
+    grid.current_stamp = 0;
+}
+
+// Makes room for keys [0, key_count) and drops every key past the end.
+void resize_spatial_grid(SpatialGrid& grid, int key_count) {
+    for (int key = key_count; key < (int) grid.ranges.size(); key++) {
+        remove_from_spatial_grid(grid, key);
+    }
+    grid.ranges.resize(key_count, (CellRange) {0, 0, -1, -1, false});
+    grid.stamps.resize(key_count, 0);
+}
+
+// Cheap when the rect still covers the same cells, so this can be called for every card every frame.
+void update_spatial_grid(SpatialGrid& grid, int key, Rectangle rect) {
+    if (key >= (int) grid.ranges.size()) resize_spatial_grid(grid, key + 1);
+    auto range = cell_range(grid, rect);
+    if (range == grid.ranges[key]) return;
+    if (grid.ranges[key].active) unfile_key(grid, key, grid.ranges[key]);
+    file_key(grid, key, range);
+    grid.ranges[key] = range;
+}
+
+void remove_from_spatial_grid(SpatialGrid& grid, int key) {
+    if (key >= (int) grid.ranges.size() || !grid.ranges[key].active) return;
+    unfile_key(grid, key, grid.ranges[key]);
+    grid.ranges[key].active = false;
+}
+
+// Appends every key filed under the cell containing `point`. Callers still need to do the exact hit test.
+void query_spatial_grid(const SpatialGrid& grid, Vector2 point, std::vector<int>& out) {
+    auto cell = grid.cells.find(cell_key((int) floorf(point.x / grid.cell_size), (int) floorf(point.y / grid.cell_size)));
+    if (cell == grid.cells.end()) return;
+    out.insert(out.end(), cell->second.begin(), cell->second.end());
+}
+
+// Appends every key filed under a cell overlapping `rect`, each key once.
+void query_spatial_grid(SpatialGrid& grid, Rectangle rect, std::vector<int>& out) {
+    grid.current_stamp += 1;
+    if (grid.current_stamp == 0) { // Wrapped around, old stamps could collide
+        std::fill(grid.stamps.begin(), grid.stamps.end(), 0);
+        grid.current_stamp = 1;
+    }
+    auto range = cell_range(grid, rect);
+    for (int y = range.min_y; y <= range.max_y; y++) {
+        for (int x = range.min_x; x <= range.max_x; x++) {
+            auto cell = grid.cells.find(cell_key(x, y));
+            if (cell == grid.cells.end()) continue;
+            for (auto key: cell->second) {
+                if (grid.stamps[key] == grid.current_stamp) continue;
+                grid.stamps[key] = grid.current_stamp;
+                out.push_back(key);
+            }
+        }
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include "common.hpp"
+#include <unordered_map>
+
+// Size of one bucket in world units. A default card (17x13 grid squares) spans about four cells.
+#define SPATIAL_CELL_SIZE (GRIDSIZE * 16)
+
+struct CellRange {
+    int min_x;
+    int min_y;
+    int max_x;
+    int max_y;
+    bool active;
+};
+
+// Uniform grid over world space. Every key (a card index) is filed under each cell its rect touches,
+// so point and rectangle queries only have to look at the keys near them.
+struct SpatialGrid {
+    float cell_size;
+    std::unordered_map<long long, std::vector<int>> cells;
+    std::vector<CellRange> ranges; // Cells each key is currently filed under, indexed by key
+    std::vector<unsigned int> stamps; // Used to report a key only once per rectangle query
+    unsigned int current_stamp;
+};
+
+SpatialGrid init_spatial_grid(float cell_size = SPATIAL_CELL_SIZE);
+void clear_spatial_grid(SpatialGrid& grid);
+void resize_spatial_grid(SpatialGrid& grid, int key_count);
+void update_spatial_grid(SpatialGrid& grid, int key, Rectangle rect);
+void remove_from_spatial_grid(SpatialGrid& grid, int key);
+void query_spatial_grid(const SpatialGrid& grid, Vector2 point, std::vector<int>& out);
+void query_spatial_grid(SpatialGrid& grid, Rectangle rect, std::vector<int>& out);
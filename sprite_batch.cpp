@@ -0,0 +1,182 @@
+#include "sprite_batch.hpp"
+#include "common.hpp"
+
+static void submit(const SpriteQuad& quad) {
+    if (quad.is_glyph) {
+        DrawTextCodepoint(quad.font, quad.codepoint, (Vector2) {quad.dest.x, quad.dest.y}, quad.dest.width, quad.tint);
+    } else {
+        DrawTexturePro(quad.texture, quad.source, quad.dest, (Vector2) {0, 0}, 0.0, quad.tint);
+    }
+}
+
+static void record(SpriteBatch& batch, const SpriteQuad& quad) {
+    auto &layer = batch.layers[batch.layer];
+    int texture = std::find(layer.textures.begin(), layer.textures.end(), quad.texture.id) - layer.textures.begin();
+    if (texture == (int) layer.textures.size()) layer.textures.push_back(quad.texture.id);
+    if (texture < layer.card_texture) layer.keep_order = true;
+    layer.card_texture = texture;
+    layer.quads.push_back(quad);
+}
+
+static void submit_layer(SpriteBatch& batch, SpriteLayerBatch& layer) {
+    if (layer.keep_order) {
+        unsigned int last_texture = 0;
+        for (int i = 0; i < (int) layer.quads.size(); i++) {
+            if (i == 0 || layer.quads[i].texture.id != last_texture) batch.draw_calls += 1;
+            last_texture = layer.quads[i].texture.id;
+            submit(layer.quads[i]);
+        }
+    } else {
+        for (auto texture: layer.textures) {
+            for (const auto &quad: layer.quads) {
+                if (quad.texture.id == texture) submit(quad);
+            }
+        }
+        batch.draw_calls += layer.textures.size();
+    }
+    layer.quads.clear();
+    layer.textures.clear();
+    layer.card_texture = -1;
+    layer.keep_order = false;
+}
+
+SpriteBatch init_sprite_batch() {
+    SpriteBatch batch;
+    batch.recording = false;
+    batch.layer = SPRITE_LAYER_UNDER;
+    for (auto &layer: batch.layers) {
+        layer.quads = std::vector<SpriteQuad>();
+        layer.textures = std::vector<unsigned int>();
+        layer.card_texture = -1;
+        layer.keep_order = false;
+    }
+    batch.band_grid = init_spatial_grid();
+    batch.band_keys = std::vector<int>();
+    batch.band_bounds = std::vector<Rectangle>();
+    batch.candidates = std::vector<int>();
+    batch.draw_calls = 0;
+    batch.flushes = 0;
+    return batch;
+}
+
+void begin_sprite_batch(SpriteBatch& batch) {
+    batch.recording = true;
+    batch.layer = SPRITE_LAYER_UNDER;
+    batch.draw_calls = 0;
+    batch.flushes = 0;
+}
+
+// Draws everything recorded so far and starts a new band. Whatever shader mode is active applies to all of it.
+void flush_sprite_batch(SpriteBatch& batch) {
+    bool empty = true;
+    for (const auto &layer: batch.layers) empty = empty && layer.quads.empty();
+    if (!empty) {
+        batch.recording = false;
+        for (auto &layer: batch.layers) submit_layer(batch, layer);
+        batch.recording = true;
+        batch.flushes += 1;
+    }
+    for (auto key: batch.band_keys) remove_from_spatial_grid(batch.band_grid, key);
+    batch.band_keys.clear();
+}
+
+void end_sprite_batch(SpriteBatch& batch) {
+    flush_sprite_batch(batch);
+    batch.recording = false;
+}
+
+void set_sprite_layer(SpriteBatch& batch, SpriteLayer layer) {
+    batch.layer = layer;
+}
+
+// Whether something drawn in `bounds` would overlap a card already in the band.
+bool overlaps_sprite_band(SpriteBatch& batch, Rectangle bounds) {
+    batch.candidates.clear();
+    query_spatial_grid(batch.band_grid, bounds, batch.candidates);
+    for (auto key: batch.candidates) {
+        if (collide(batch.band_bounds[key], bounds)) return true;
+    }
+    return false;
+}
+
+// Sprites recorded after this belong to the card `key`.
+void add_to_sprite_band(SpriteBatch& batch, int key, Rectangle bounds) {
+    for (auto &layer: batch.layers) layer.card_texture = -1;
+    if (key >= (int) batch.band_bounds.size()) batch.band_bounds.resize(key + 1);
+    batch.band_bounds[key] = bounds;
+    batch.band_keys.push_back(key);
+    update_spatial_grid(batch.band_grid, key, bounds);
+}
+
+void draw_sprite(Texture2D texture, Rectangle source, Rectangle dest, Color tint) {
+    if (!sprite_batch.recording) {
+        DrawTexturePro(texture, source, dest, (Vector2) {0, 0}, 0.0, tint);
+        return;
+    }
+    SpriteQuad quad = {0};
+    quad.texture = texture;
+    quad.source = source;
+    quad.dest = dest;
+    quad.tint = tint;
+    record(sprite_batch, quad);
+}
+
+// Rectangles are drawn with the shapes texture, so they only batch with the spritesheet once
+// SetShapesTexture has pointed it at SPRITESHEET_WHITE_TEXEL.
+void draw_sprite_rect(Rectangle rect, Color color) {
+    if (!sprite_batch.recording) {
+        DrawRectangleRec(rect, color);
+        return;
+    }
+    draw_sprite(GetShapesTexture(), GetShapesTextureRec(), rect, color);
+}
+
+void draw_sprite_rect_lines(Rectangle rect, float line_thick, Color color) {
+    draw_sprite_rect({rect.x, rect.y, rect.width, line_thick}, color);
+    draw_sprite_rect({rect.x + rect.width - line_thick, rect.y + line_thick, line_thick, rect.height - line_thick * 2}, color);
+    draw_sprite_rect({rect.x, rect.y + rect.height - line_thick, rect.width, line_thick}, color);
+    draw_sprite_rect({rect.x, rect.y + line_thick, line_thick, rect.height - line_thick * 2}, color);
+}
+
+void draw_sprite_codepoint(Font font, int codepoint, Vector2 position, float font_size, Color tint) {
+    if (!sprite_batch.recording) {
+        DrawTextCodepoint(font, codepoint, position, font_size, tint);
+        return;
+    }
+    SpriteQuad quad = {0};
+    quad.texture = font.texture;
+    quad.dest = {position.x, position.y, font_size, font_size};
+    quad.tint = tint;
+    quad.is_glyph = true;
+    quad.font = font;
+    quad.codepoint = codepoint;
+    record(sprite_batch, quad);
+}
+
+// Same as DrawTextEx.
+void draw_sprite_text(Font font, const char *text, Vector2 position, float font_size, float spacing, Color tint) {
+    if (!sprite_batch.recording) {
+        DrawTextEx(font, text, position, font_size, spacing, tint);
+        return;
+    }
+    float scale_factor = font_size / font.baseSize;
+    float offset_x = 0;
+    float offset_y = 0;
+    for (int i = 0; text[i] != '\0';) {
+        int byte_count = 0;
+        int codepoint = GetNextCodepoint(&text[i], &byte_count);
+        if (codepoint == 0x3f) byte_count = 1;
+        int index = GetGlyphIndex(font, codepoint);
+        if (codepoint == '\n') {
+            offset_y += (int) ((font.baseSize + font.baseSize / 2) * scale_factor);
+            offset_x = 0;
+        } else {
+            if (codepoint != ' ' && codepoint != '\t') {
+                draw_sprite_codepoint(font, codepoint, {position.x + offset_x, position.y + offset_y}, font_size, tint);
+            }
+            if (font.chars[index].advanceX == 0) offset_x += font.recs[index].width * scale_factor + spacing;
+            else offset_x += font.chars[index].advanceX * scale_factor + spacing;
+        }
+        i += byte_count > 0 ? byte_count : 1;
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "common.hpp"
+#include "spatial_grid.hpp"
+
+// Spritesheet texel that's pure white, used as the shapes texture so rectangles batch with the sprites around them.
+#define SPRITESHEET_WHITE_TEXEL (Rectangle) {51, 32, 1, 1}
+
+// What part of a card a sprite belongs to. Within a band every card's sprites are drawn a layer at a time, in the
+// order below, so each layer only changes texture once or twice.
+// Within a layer a card should use its textures in the same order as every other card, or draw anything of one
+// texture that covers another in a later layer. Otherwise the layer can't be regrouped, see SpriteLayerBatch.
+enum SpriteLayer {
+    SPRITE_LAYER_UNDER,     // Card bodies and cached card images
+    SPRITE_LAYER_SELECTION, // Selection and caret of the text being written, which use the shapes texture
+    SPRITE_LAYER_TEXT,      // Card text
+    SPRITE_LAYER_OVER,      // Labels, markers and buttons drawn on top of the text
+    SPRITE_LAYER_COUNT,
+};
+
+struct SpriteQuad {
+    Texture2D texture;
+    Rectangle source;
+    Rectangle dest;
+    Color tint;
+    // Glyphs keep the font around so they can go through DrawTextCodepoint. `dest` then holds the position and size.
+    bool is_glyph;
+    Font font;
+    int codepoint;
+};
+
+// Sprites recorded into one layer of the band. They're submitted one texture at a time, in the order each texture
+// was first used. Cards in a band don't overlap, so that only changes what's on top if a card's own sprites of
+// two textures overlap and the card used them in the opposite order to that. As soon as any card uses a texture
+// that was first used before the one it last used, the layer is submitted in the order it was recorded instead.
+struct SpriteLayerBatch {
+    std::vector<SpriteQuad> quads;
+    std::vector<unsigned int> textures; // In the order they were first used
+    int card_texture; // Index into `textures` of the last one the current card used, -1 before it used any
+    bool keep_order;
+};
+
+// Records sprites instead of drawing them, then submits them grouped by layer and texture.
+// Cards go into the batch as a band: a run of cards in draw order that don't overlap each other, so regrouping
+// their sprites can't change what ends up on top. A card that overlaps the band has to wait for the next one.
+struct SpriteBatch {
+    bool recording;
+    SpriteLayer layer;
+    SpriteLayerBatch layers[SPRITE_LAYER_COUNT];
+
+    SpatialGrid band_grid; // Bounds of the cards in the current band, keyed by card index
+    std::vector<int> band_keys;
+    std::vector<Rectangle> band_bounds;
+    std::vector<int> candidates;
+
+    int draw_calls; // Texture changes submitted since begin_sprite_batch
+    int flushes;
+};
+
+extern SpriteBatch sprite_batch;
+
+SpriteBatch init_sprite_batch();
+void begin_sprite_batch(SpriteBatch& batch);
+void flush_sprite_batch(SpriteBatch& batch);
+void end_sprite_batch(SpriteBatch& batch);
+void set_sprite_layer(SpriteBatch& batch, SpriteLayer layer);
+bool overlaps_sprite_band(SpriteBatch& batch, Rectangle bounds);
+void add_to_sprite_band(SpriteBatch& batch, int key, Rectangle bounds);
+
+// Drop-in replacements for the raylib calls that go through the batch while it's recording.
+void draw_sprite(Texture2D texture, Rectangle source, Rectangle dest, Color tint = WHITE);
+void draw_sprite_rect(Rectangle rect, Color color);
+void draw_sprite_rect_lines(Rectangle rect, float line_thick, Color color);
+void draw_sprite_codepoint(Font font, int codepoint, Vector2 position, float font_size, Color tint);
+void draw_sprite_text(Font font, const char *text, Vector2 position, float font_size, float spacing, Color tint);
@@ -0,0 +1,22 @@
+// The globals main.cpp defines for the rest of the game. Nothing here is loaded, so anything that draws or
+// measures text can't be checked from the tests.
+#include "common.hpp"
+#include "card.hpp"
+#include "sprite_batch.hpp"
+#include "thread_pool.hpp"
+
+Vector2 previous_mouse_position = {0};
+
+Font application_font_small;
+Font application_font_regular;
+Font application_font_large;
+
+Texture2D spritesheet;
+Shader darken_shader;
+
+SpatialGrid card_grid;
+std::vector<int> card_draw_order;
+SpriteBatch sprite_batch;
+CardHotStore card_hot;
+CardHandleTable card_handles;
+ThreadPool worker_pool;
@@ -0,0 +1,217 @@
+// Times saving and loading a generated board of 50000 cards: JSON through the SAX loader load_cards uses and
+// through the json document it replaced, and binary saves loaded eagerly and lazily. Every load runs in a fresh
+// copy of this program, so the peak RSS it reports is its own and not whatever an earlier load reached.
+#include "card.hpp"
+#include "card_pool.hpp"
+#include "json.hpp"
+#include "serialization.hpp"
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sys/resource.h>
+
+using json = nlohmann::json;
+
+#define BOARD_SIZE 50000
+#define REPEATS 3
+
+static double milliseconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Peak resident set size so far, in kilobytes on Linux.
+static long peak_rss() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Cards of a few dozen words laid out on a grid, with scenes tucked under every tenth one.
+static void fill_board(CardPool& cards) {
+    const char *words[] = {"the", "dragon", "king", "falls", "and", "river", "burns", "a", "quiet", "Empire", "of",
+        "salt", "Glass", "tower", "ashen", "kingdom", "under", "sky"};
+    std::mt19937 rng(BOARD_SIZE);
+    auto text = [&](int word_count) {
+        std::string text;
+        for (int j = 0; j < word_count; j++) {
+            if (j > 0) text += ' ';
+            text += words[rng() % 18];
+        }
+        return text;
+    };
+    for (int i = 0; i < BOARD_SIZE; i++) {
+        auto card = init_card("", {(float) (i % 200) * 400, (float) (i / 200) * 300, 272, 208}, (CardType) (rng() % (LEGACY + 1)));
+        card.tone = rng() % 2 ? LIGHT : DARK;
+        card.content = text(6 + rng() % 40);
+        for (int j = 0; i % 10 == 0 && j < 2; j++) {
+            auto tucked = init_card("", {0, 0, 272, 208}, SCENE);
+            tucked.content = text(6 + rng() % 20);
+            tucked.saved_dimensions = {272, 208};
+            card.cards_under.push_back(tucked);
+        }
+        touch_card_content(card);
+        add_card(cards, card);
+    }
+}
+
+static void set_font(Card& card, FontSize fontsize) {
+    card.fontsize = fontsize;
+    switch (fontsize) {
+    case SMALL:
+        card.font = &application_font_small;
+        break;
+    case REGULAR:
+        card.font = &application_font_regular;
+        break;
+    case LARGE:
+        card.font = &application_font_large;
+        break;
+    }
+}
+
+// The loader the SAX one replaced: the whole file is read into a json document, then copied out of it. Every
+// card and card under one also gets a fresh UUID from init_card, only to be overwritten by its saved id.
+static bool load_cards_dom(CardPool& cards, const char *filename) {
+    std::ifstream file(filename);
+    json j;
+    file >> j;
+    for (auto &card_json: j["cards"]) {
+        auto card = init_card("", {0, 0, GRIDSIZE * 17, GRIDSIZE * 13});
+        card.id = card_json.at("id");
+        card.type = card_json.at("type");
+        card.tone = card_json.at("tone");
+        card.body_rect.x = card.lock_target.x = card_json.at("x");
+        card.body_rect.y = card.lock_target.y = card_json.at("y");
+        card.body_rect.width = card_json.at("w");
+        card.body_rect.height = card_json.at("h");
+        card.content = card_json.at("content");
+        if (card_json.count("fontsize") > 0) set_font(card, card_json.at("fontsize"));
+        if (card_json.count("cards_under") > 0) {
+            for (auto &under_json: card_json.at("cards_under")) {
+                auto under_card = init_card("", {0, 0, GRIDSIZE * 17, GRIDSIZE * 13});
+                under_card.parent = acquire_card_handle(card);
+                under_card.id = under_json.at("id");
+                under_card.type = under_json.at("type");
+                under_card.tone = under_json.at("tone");
+                under_card.content = under_json.at("content");
+                if (under_json.count("fontsize") > 0) set_font(under_card, under_json.at("fontsize"));
+                under_card.saved_dimensions.x = under_json.at("saved_dimensions_x");
+                under_card.saved_dimensions.y = under_json.at("saved_dimensions_y");
+                card.cards_under.push_back(std::move(under_card));
+            }
+        }
+        if (card_json.count("is_beginning") > 0) card.is_beginning = true;
+        if (card_json.count("is_end") > 0) card.is_end = true;
+        add_card(cards, card);
+    }
+    return true;
+}
+
+// Run as `save_bench load <how> <file>`: loads the file once and prints the milliseconds it took, the kilobytes
+// peak RSS rose by and the number of cards loaded.
+static int run_load(const char *how, const char *filename) {
+    card_grid = init_spatial_grid();
+    auto cards = init_pool();
+    long rss_before = peak_rss();
+    auto start = std::chrono::steady_clock::now();
+    bool loaded = false;
+    if (strcmp(how, "dom") == 0) loaded = load_cards_dom(cards, filename);
+    else if (strcmp(how, "sax") == 0) loaded = load_cards(cards, filename);
+    else if (strcmp(how, "binary") == 0) loaded = load_cards_binary(cards, filename);
+    else if (strcmp(how, "lazy") == 0) loaded = load_cards_binary(cards, filename, true);
+    else if (strcmp(how, "lazy_read") == 0) {
+        loaded = load_cards_binary(cards, filename, true);
+        load_lazy_cards(cards);
+    }
+    double time = milliseconds_since(start);
+    printf("%f %ld %d\n", time, peak_rss() - rss_before, loaded ? cards.active_cards : -1);
+    load_lazy_cards(cards);
+    return loaded ? 0 : 1;
+}
+
+struct LoadTiming {
+    double milliseconds; // Best of REPEATS
+    long rss_kb;         // Largest rise in peak RSS
+    bool whole;          // Every run loaded every card
+};
+
+static LoadTiming time_load(const char *program, const char *how, const char *filename) {
+    LoadTiming timing = {0, 0, true};
+    for (int i = 0; i < REPEATS; i++) {
+        std::string command = std::string(program) + " load " + how + " " + filename;
+        FILE *output = popen(command.c_str(), "r");
+        double time = 0;
+        long rss = 0;
+        int loaded = -1;
+        if (output == NULL || fscanf(output, "%lf %ld %d", &time, &rss, &loaded) != 3) loaded = -1;
+        if (output != NULL && pclose(output) != 0) loaded = -1;
+        if (i == 0 || time < timing.milliseconds) timing.milliseconds = time;
+        timing.rss_kb = std::max(timing.rss_kb, rss);
+        timing.whole = timing.whole && loaded == BOARD_SIZE;
+    }
+    return timing;
+}
+
+// Milliseconds to write the board with `save`, best of REPEATS.
+static double time_save(CardPool& cards, bool (*save)(CardPool&, const char*), const char *savefile, bool& saved) {
+    double best = 0;
+    for (int i = 0; i < REPEATS; i++) {
+        auto start = std::chrono::steady_clock::now();
+        saved = save(cards, savefile) && saved;
+        double time = milliseconds_since(start);
+        if (i == 0 || time < best) best = time;
+    }
+    return best;
+}
+
+static long file_size(const char *filename) {
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    return file ? (long) file.tellg() : 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc == 4 && strcmp(argv[1], "load") == 0) return run_load(argv[2], argv[3]);
+
+    card_grid = init_spatial_grid();
+    auto cards = init_pool();
+    fill_board(cards);
+    update_cards(cards);
+    const char *json_file = "save_bench.json";
+    const char *binary_file = "save_bench.bin";
+    bool saved = true;
+    double json_ms = time_save(cards, save_cards, json_file, saved);
+    double binary_ms = time_save(cards, save_cards_binary, binary_file, saved);
+    if (!saved) {
+        printf("couldn't write the saves\n");
+        return 1;
+    }
+    printf("%d cards\n", BOARD_SIZE);
+    printf("    saving JSON            %7.1f ms, %.1f MB\n", json_ms, file_size(json_file) / 1e6);
+    printf("    saving binary          %7.1f ms, %.1f MB\n", binary_ms, file_size(binary_file) / 1e6);
+
+    struct Load {
+        const char *how;
+        const char *name;
+        const char *filename;
+    };
+    Load loads[] = {
+        {"dom", "JSON document", json_file},
+        {"sax", "JSON SAX", json_file},
+        {"binary", "binary", binary_file},
+        {"lazy", "binary, lazy", binary_file},
+        {"lazy_read", "lazy, all read", binary_file}, // Then every card's text read in, as a full save does
+    };
+    bool whole = true;
+    for (auto &load: loads) {
+        auto timing = time_load(argv[0], load.how, load.filename);
+        printf("    loading %-14s %7.1f ms, peak RSS +%ld MB\n", load.name, timing.milliseconds, timing.rss_kb / 1024);
+        whole = whole && timing.whole;
+    }
+    printf("every load %s\n", whole ? "read every card" : "DIDN'T READ EVERY CARD");
+
+    std::remove(json_file);
+    std::remove(binary_file);
+    free_pool(cards);
+    return whole ? 0 : 1;
+}
@@ -0,0 +1,166 @@
+// Checks binary saves: that a board loads back the same from a version 2 save, eagerly and lazily, and from
+// the same save rewritten as version 1, and that cut short or damaged saves are turned away before anything is
+// added, or only add cards the rest of the game can use.
+#include "journal.hpp"
+#include "save_test_cards.hpp"
+#include "serialization.hpp"
+
+#define HEADER_SIZE 20
+
+static uint32_t get_u32(const std::string& bytes, size_t at) {
+    const unsigned char *data = (const unsigned char*) bytes.data() + at;
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t) data[3] << 24);
+}
+
+static void put_u32(std::string& bytes, size_t at, uint32_t value) {
+    for (int i = 0; i < 4; i++) bytes[at + i] = (char) (value >> (i * 8));
+}
+
+// The same save as version 1, which is version 2 without the string offsets.
+static std::string version_1(const std::string& bytes) {
+    uint32_t string_count = get_u32(bytes, 8);
+    std::string old = bytes.substr(0, HEADER_SIZE) + bytes.substr(HEADER_SIZE + string_count * 4);
+    put_u32(old, 4, 1);
+    return old;
+}
+
+// Loads `filename` into an empty board, reading in lazy cards' text afterwards so it's all checked.
+static bool load(CardPool& cards, const char *filename, bool lazy) {
+    load_lazy_cards(cards);
+    clear_cards(cards);
+    bool loaded = load_cards_binary(cards, filename, lazy);
+    load_lazy_cards(cards);
+    return loaded;
+}
+
+static bool same_board(CardPool& cards, const std::vector<Card>& original) {
+    auto loaded = board_cards(cards);
+    bool same = loaded.size() == original.size();
+    for (size_t i = 0; same && i < loaded.size(); i++) same = same_card(loaded[i], original[i]);
+    return same;
+}
+
+static bool board_usable(CardPool& cards) {
+    bool usable = true;
+    for (auto &card: cards) usable = usable && valid_enums(card);
+    return usable;
+}
+
+int main() {
+    card_grid = init_spatial_grid();
+    auto cards = init_pool();
+    std::mt19937 rng(20);
+    const char *savefile = "save_binary_test.bin";
+    std::remove(journal_filename(savefile).c_str());
+
+    for (int i = 0; i < 400; i++) add_card(cards, random_card(rng));
+    update_cards(cards);
+    auto original = board_cards(cards);
+    check(save_cards_binary(cards, savefile), "save_cards_binary");
+    std::string bytes = read_file(savefile);
+    check(load(cards, savefile, false) && same_board(cards, original), "400 cards load back the same");
+    check(load(cards, savefile, true) && same_board(cards, original), "400 cards load back the same lazily");
+    load_lazy_cards(cards);
+    clear_cards(cards);
+    bool loaded = load_cards(cards, savefile);
+    load_lazy_cards(cards);
+    check(loaded && same_board(cards, original), "load_cards recognises a binary save");
+
+    // Saving a board that's still reading from its save, then loading that, changes nothing either.
+    load_lazy_cards(cards);
+    clear_cards(cards);
+    load_cards_binary(cards, savefile, true);
+    const char *resaved = "save_binary_test_resaved.bin";
+    check(save_cards_binary(cards, resaved) && read_file(resaved) == bytes, "saving lazy cards writes the same bytes");
+    std::remove(resaved);
+
+    write_file(savefile, version_1(bytes));
+    check(load(cards, savefile, false) && same_board(cards, original), "a version 1 save loads the same");
+    check(load(cards, savefile, true) && same_board(cards, original), "a version 1 save loads the same lazily");
+
+    // A smaller board, so it can be cut short at every byte.
+    load_lazy_cards(cards);
+    clear_cards(cards);
+    for (int i = 0; i < 12; i++) add_card(cards, random_card(rng));
+    update_cards(cards);
+    original = board_cards(cards);
+    check(save_cards_binary(cards, savefile), "save_cards_binary");
+    bytes = read_file(savefile);
+    for (int lazy = 0; lazy < 2; lazy++) {
+        bool all_failed = true, none_added = true;
+        for (size_t length = 0; length < bytes.size(); length++) {
+            write_file(savefile, bytes.substr(0, length));
+            all_failed = all_failed && !load(cards, savefile, lazy);
+            none_added = none_added && cards.active_cards == 0;
+        }
+        check(all_failed, lazy ? "every save cut short fails to load lazily" : "every save cut short fails to load");
+        check(none_added, "a save cut short adds nothing");
+    }
+
+    // Headers and records pointing outside the file or past the end of the tables.
+    uint32_t string_count = get_u32(bytes, 8);
+    uint32_t card_count = get_u32(bytes, 12);
+    uint32_t under_count = get_u32(bytes, 16);
+    size_t records = bytes.size() - card_count * 36 - under_count * 20;
+    struct Damage {
+        size_t at;
+        uint32_t value;
+        const char *what;
+    };
+    Damage damages[] = {
+        {4, 0, "version 0"},
+        {4, BINARY_SAVE_VERSION + 1, "a version from the future"},
+        {8, 0xffffffff, "a string count past the end of the file"},
+        {8, string_count + 1, "one string too many"},
+        {12, card_count + 1, "one card too many"},
+        {12, 0x40000000, "a card count that overflows 32 bits of bytes"},
+        {16, under_count + 1, "one under card too many"},
+        {HEADER_SIZE, 0xfffffff0, "a string offset past the end of the file"},
+        {HEADER_SIZE + (string_count - 1) * 4, (uint32_t) bytes.size() - 2, "the last string's length cut off"},
+        {records, string_count, "an id past the string table"},
+        {records + 4, 0xffffffff, "content past the string table"},
+        {records + 8, LEGACY + 1 | (DARK << 8), "a type out of range"},
+        {records + 28, under_count + 1, "cards under starting past the under cards"},
+        {records + 28, 0xffffffff, "cards under starting at -1"},
+        {records + 32, 0xffffffff, "a count of cards under that overflows"},
+    };
+    for (auto &damage: damages) {
+        std::string damaged = bytes;
+        put_u32(damaged, damage.at, damage.value);
+        write_file(savefile, damaged);
+        for (int lazy = 0; lazy < 2; lazy++) {
+            bool loaded = load(cards, savefile, lazy);
+            if (loaded || cards.active_cards != 0) {
+                failures++;
+                printf("FAILED: %s loads%s\n", damage.what, lazy ? " lazily" : "");
+            }
+        }
+    }
+
+    // Random damage may or may not be caught, depending on where it lands, but whatever loads has to be usable,
+    // and has to save again.
+    bool usable = true;
+    for (int round = 0; round < 3000; round++) {
+        std::string damaged = bytes;
+        int changes = 1 + rng() % 3;
+        for (int i = 0; i < changes; i++) damaged[rng() % damaged.size()] = (char) rng();
+        write_file(savefile, damaged);
+        bool lazy = round % 2;
+        load(cards, savefile, lazy);
+        usable = usable && board_usable(cards);
+        load_lazy_cards(cards);
+        clear_cards(cards);
+        load_cards_binary(cards, savefile, lazy);
+        // This also reads in the lazy cards, which have to be done with the save before it's written over.
+        bool saved = save_cards_binary(cards, "save_binary_test_resaved.bin");
+        usable = usable && saved;
+    }
+    check(usable, "damaged saves only load cards with valid types, tones and font sizes");
+    std::remove("save_binary_test_resaved.bin");
+
+    load_lazy_cards(cards);
+    std::remove(savefile);
+    free_pool(cards);
+    printf("%d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,136 @@
+// Checks JSON saves: that the streaming writer's output parses back to what was written, that a board saved
+// with save_cards loads back the same, and that cut short or damaged saves fail to load without adding
+// anything broken.
+#include "journal.hpp"
+#include "json.hpp"
+#include "json_writer.hpp"
+#include "save_test_cards.hpp"
+#include "serialization.hpp"
+
+using json = nlohmann::json;
+
+static void check_writer(std::mt19937& rng) {
+    for (int round = 0; round < 200; round++) {
+        std::vector<std::string> strings;
+        std::vector<long long> ints;
+        std::vector<float> floats;
+        for (int i = 0; i < 20; i++) {
+            strings.push_back(random_text(rng, rng() % 40));
+            ints.push_back((long long) ((uint64_t) rng() << 32 | rng()));
+            floats.push_back(random_float(rng));
+        }
+        std::ostringstream out;
+        auto writer = init_json_writer(out);
+        json_begin_object(writer);
+        json_key(writer, "strings");
+        json_begin_array(writer);
+        for (auto &value: strings) json_string(writer, value);
+        json_end_array(writer);
+        json_key(writer, "ints");
+        json_begin_array(writer);
+        for (auto value: ints) json_int(writer, value);
+        json_end_array(writer);
+        json_key(writer, "floats");
+        json_begin_array(writer);
+        for (auto value: floats) json_float(writer, value);
+        json_end_array(writer);
+        json_key(writer, "empty");
+        json_begin_object(writer);
+        json_end_object(writer);
+        json_key(writer, "nested");
+        json_begin_array(writer);
+        json_begin_array(writer);
+        json_end_array(writer);
+        json_bool(writer, true);
+        json_bool(writer, false);
+        json_float(writer, NAN);
+        json_end_array(writer);
+        json_end_object(writer);
+
+        json parsed = json::parse(out.str(), nullptr, false);
+        check(!parsed.is_discarded(), "writer output parses");
+        if (parsed.is_discarded()) continue;
+        bool same = parsed["strings"].size() == strings.size() && parsed["ints"].size() == ints.size() &&
+            parsed["floats"].size() == floats.size();
+        for (size_t i = 0; same && i < strings.size(); i++) {
+            same = parsed["strings"][i].get<std::string>() == strings[i] && parsed["ints"][i].get<long long>() == ints[i] &&
+                same_float(parsed["floats"][i].get<float>(), floats[i]);
+        }
+        check(same, "strings, ints and floats read back the same");
+        check(parsed["empty"].is_object() && parsed["empty"].empty(), "empty object");
+        check(parsed["nested"] == json::parse("[[], true, false, null]"), "nested array, bools and NaN as null");
+    }
+}
+
+// Every card that did load is whole, usable, and the card at its place in `original`.
+static bool loaded_prefix(CardPool& cards, const std::vector<Card>& original) {
+    size_t i = 0;
+    for (auto &card: cards) {
+        if (!valid_enums(card)) return false;
+        if (i < original.size() && !same_card(card, original[i])) return false;
+        i++;
+    }
+    return i <= original.size();
+}
+
+int main() {
+    card_grid = init_spatial_grid();
+    auto cards = init_pool();
+    std::mt19937 rng(19);
+    const char *savefile = "save_json_test.json";
+    std::remove(journal_filename(savefile).c_str());
+
+    check_writer(rng);
+
+    for (int i = 0; i < 400; i++) add_card(cards, random_card(rng));
+    update_cards(cards);
+    auto original = board_cards(cards);
+    check(save_cards(cards, savefile), "save_cards");
+    clear_cards(cards);
+    check(load_cards(cards, savefile), "load_cards");
+    auto loaded = board_cards(cards);
+    bool same = loaded.size() == original.size();
+    for (size_t i = 0; same && i < loaded.size(); i++) same = same_card(loaded[i], original[i]);
+    check(same, "400 cards load back the same");
+
+    // A smaller board, so it can be cut short at every byte.
+    clear_cards(cards);
+    for (int i = 0; i < 12; i++) add_card(cards, random_card(rng));
+    update_cards(cards);
+    original = board_cards(cards);
+    check(save_cards(cards, savefile), "save_cards");
+    std::string bytes = read_file(savefile);
+    // The writer ends the file with a newline, which the parser doesn't need.
+    size_t end = bytes.find_last_of('}') + 1;
+    bool all_failed = true, all_prefixes = true;
+    for (size_t length = 0; length < end; length++) {
+        write_file(savefile, bytes.substr(0, length));
+        clear_cards(cards);
+        all_failed = all_failed && !load_cards(cards, savefile);
+        all_prefixes = all_prefixes && loaded_prefix(cards, original);
+    }
+    check(all_failed, "every save cut short fails to load");
+    check(all_prefixes, "a save cut short only adds the whole cards before the cut");
+
+    // Damaged bytes may or may not still parse, but whatever loads has to be usable.
+    bool usable = true;
+    for (int round = 0; round < 3000; round++) {
+        std::string damaged = bytes;
+        int changes = 1 + rng() % 3;
+        for (int i = 0; i < changes; i++) {
+            size_t at = rng() % damaged.size();
+            if (rng() % 2) damaged[at] = "0123456789-.e\"{}[],: "[rng() % 21];
+            else damaged[at] = (char) rng();
+        }
+        write_file(savefile, damaged);
+        clear_cards(cards);
+        load_cards(cards, savefile);
+        for (auto &card: cards) usable = usable && valid_enums(card);
+    }
+    check(usable, "damaged saves only load cards with valid types, tones and font sizes");
+
+    std::remove(savefile);
+    free_pool(cards);
+    printf("%d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,117 @@
+#pragma once
+// What the save tests share: random cards and text, and comparing cards field by field.
+#include "card.hpp"
+#include "card_pool.hpp"
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+static int failures = 0;
+
+static void check(bool passed, const char *what) {
+    if (passed) return;
+    failures++;
+    printf("FAILED: %s\n", what);
+}
+
+// Text with everything the writer has to escape, and multi-byte characters it mustn't.
+static std::string random_text(std::mt19937& rng, int length) {
+    const char *pieces[] = {"a", "Z", " ", "\"", "\\", "/", "\n", "\r", "\t", "\b", "\f", "\x01", "\x1f", "\x7f",
+        "é", "—", "Ω", "😀", "{", "}", "[", "]", ":", ",", "null", "\\u0041"};
+    std::string text;
+    for (int i = 0; i < length; i++) text += pieces[rng() % 26];
+    return text;
+}
+
+static float random_float(std::mt19937& rng) {
+    switch (rng() % 4) {
+    case 0: return (float) (int) (rng() % 4000) - 2000;
+    case 1: return ((float) rng() / 4294967296.0f - 0.5f) * 1e6f;
+    case 2: return 1e-40f * (float) (rng() % 100); // Denormals
+    default: {
+        // Any finite bit pattern.
+        uint32_t bits = rng();
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return std::isfinite(value) ? value : 0.0f;
+    }
+    }
+}
+
+static bool same_float(float value1, float value2) {
+    return memcmp(&value1, &value2, sizeof(float)) == 0 || (value1 == 0 && value2 == 0);
+}
+
+static Card random_card(std::mt19937& rng) {
+    Rectangle rect = {random_float(rng), random_float(rng), 40 + (float) (rng() % 600), 40 + (float) (rng() % 600)};
+    auto card = init_card("", rect, (CardType) (rng() % (LEGACY + 1)));
+    card.tone = rng() % 2 ? LIGHT : DARK;
+    set_card_fontsize(card, (FontSize) (rng() % (LARGE + 1)));
+    card.is_beginning = rng() % 10 == 0;
+    card.is_end = rng() % 10 == 0;
+    card.content = random_text(rng, rng() % 60);
+    int under = rng() % 4 == 0 ? 1 + rng() % 3 : 0;
+    for (int i = 0; i < under; i++) {
+        auto tucked = init_card("", {0, 0, 272, 208}, (CardType) (rng() % (LEGACY + 1)));
+        tucked.tone = rng() % 2 ? LIGHT : DARK;
+        set_card_fontsize(tucked, (FontSize) (rng() % (LARGE + 1)));
+        tucked.content = random_text(rng, rng() % 30);
+        tucked.saved_dimensions = {random_float(rng), random_float(rng)};
+        card.cards_under.push_back(tucked);
+    }
+    touch_card_content(card);
+    return card;
+}
+
+static bool same_card(const Card& card1, const Card& card2) {
+    if (card1.id != card2.id || card1.content != card2.content || card1.type != card2.type || card1.tone != card2.tone ||
+        card1.fontsize != card2.fontsize || card1.is_beginning != card2.is_beginning || card1.is_end != card2.is_end ||
+        !same_float(card1.body_rect.x, card2.body_rect.x) || !same_float(card1.body_rect.y, card2.body_rect.y) ||
+        !same_float(card1.body_rect.width, card2.body_rect.width) ||
+        !same_float(card1.body_rect.height, card2.body_rect.height) ||
+        card1.cards_under.size() != card2.cards_under.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < card1.cards_under.size(); i++) {
+        auto &under1 = card1.cards_under[i];
+        auto &under2 = card2.cards_under[i];
+        if (under1.id != under2.id || under1.content != under2.content || under1.type != under2.type ||
+            under1.tone != under2.tone || under1.fontsize != under2.fontsize ||
+            !same_float(under1.saved_dimensions.x, under2.saved_dimensions.x) ||
+            !same_float(under1.saved_dimensions.y, under2.saved_dimensions.y)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static std::vector<Card> board_cards(CardPool& cards) {
+    std::vector<Card> board;
+    for (auto &card: cards) board.push_back(card);
+    return board;
+}
+
+// Nothing the card holds is out of range for the enums the rest of the game indexes arrays with.
+static bool valid_enums(const Card& card) {
+    if ((int) card.type < 0 || card.type > LEGACY || (int) card.tone < 0 || card.tone > DARK ||
+        (int) card.fontsize < 0 || card.fontsize > LARGE) {
+        return false;
+    }
+    for (auto &under_card: card.cards_under) {
+        if (!valid_enums(under_card)) return false;
+    }
+    return true;
+}
+
+static std::string read_file(const char *filename) {
+    std::ifstream file(filename, std::ios::binary);
+    std::ostringstream bytes;
+    bytes << file.rdbuf();
+    return bytes.str();
+}
+
+static void write_file(const char *filename, const std::string& bytes) {
+    std::ofstream file(filename, std::ios::binary);
+    file.write(bytes.data(), bytes.size());
+}
@@ -0,0 +1,121 @@
+// Times sharded search queries, to check SEARCH_SHARD_MIN_CANDIDATES and SEARCH_SHARDS_PER_THREAD against the
+// machine it runs on. Pass the number of worker threads to start, otherwise it starts one per extra core, and
+// at least one so there's always a thread to wake.
+#include "card.hpp"
+#include "card_pool.hpp"
+#include "search_index.hpp"
+#include "thread_pool.hpp"
+#include <chrono>
+#include <random>
+
+static double milliseconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Every fiftieth card is ten times longer than the rest, so one shard can get far more text than another.
+static void fill_board(CardPool& cards, int count) {
+    const char *words[] = {"the", "dragon", "king", "falls", "and", "river", "burns", "a", "quiet", "Empire", "of",
+        "salt", "Glass", "tower", "ashen", "kingdom", "under", "sky"};
+    std::mt19937 rng(count);
+    clear_cards(cards);
+    for (int i = 0; i < count; i++) {
+        auto card = init_card("card", {(float) (i % 100) * 400, (float) (i / 100) * 300, 272, 208});
+        int word_count = (6 + rng() % 24) * (i % 50 == 0 ? 10 : 1);
+        for (int j = 0; j < word_count; j++) {
+            card.content += words[rng() % 18];
+            card.content += ' ';
+        }
+        touch_card_content(card);
+        add_card(cards, card);
+    }
+    update_cards(cards);
+}
+
+// Typing a query a character at a time, then a fresh query that can't narrow the last one.
+static double run_queries(SearchIndex& index, ThreadPool *pool, std::vector<SearchResult>& results) {
+    std::string typed = "dragon k";
+    auto start = std::chrono::steady_clock::now();
+    for (size_t length = 1; length <= typed.size(); length++) {
+        run_search_query(index, typed.substr(0, length), pool, 8);
+        rank_search_matches(index, 8, results);
+    }
+    run_search_query(index, "kng", pool, 8);
+    rank_search_matches(index, 8, results);
+    return milliseconds_since(start);
+}
+
+static bool same_results(const std::vector<SearchResult>& results1, const std::vector<SearchResult>& results2) {
+    if (results1.size() != results2.size()) return false;
+    for (size_t i = 0; i < results1.size(); i++) {
+        if (results1[i].score != results2[i].score || results1[i].card != results2[i].card) return false;
+    }
+    return true;
+}
+
+// Milliseconds per run of run_queries with these settings, best of `repeats`. Each run starts from a fresh
+// index, so nothing is left over from the last one.
+static double time_queries(CardPool& cards, ThreadPool *pool, int min_candidates, int shards_per_thread,
+                           const std::vector<SearchResult>& expected, bool& same) {
+    const int repeats = 3;
+    double best = 0;
+    std::vector<SearchResult> results;
+    for (int i = 0; i < repeats; i++) {
+        SearchIndex index = init_search_index();
+        index.shard_min_candidates = min_candidates;
+        index.shards_per_thread = shards_per_thread;
+        refresh_search_index(index, cards);
+        double time = run_queries(index, pool, results);
+        if (i == 0 || time < best) best = time;
+        same = same && same_results(results, expected);
+    }
+    return best;
+}
+
+int main(int argc, char **argv) {
+    int threads = argc > 1 ? atoi(argv[1]) : std::max(2u, std::thread::hardware_concurrency()) - 1;
+    start_thread_pool(worker_pool, threads);
+    int pool_size = thread_pool_size(worker_pool);
+    printf("%d worker threads, %d threads to a query\n", threads, pool_size);
+    card_grid = init_spatial_grid();
+    auto cards = init_pool();
+
+    // What a batch costs on its own, against what it costs to score one candidate.
+    const int batches = 2000;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < batches; i++) run_on_thread_pool(worker_pool, pool_size * SEARCH_SHARDS_PER_THREAD, [](int) {});
+    double batch_us = milliseconds_since(start) * 1000 / batches;
+    fill_board(cards, 50000);
+    SearchIndex index = init_search_index();
+    refresh_search_index(index, cards);
+    start = std::chrono::steady_clock::now();
+    run_search_query(index, "kng");
+    double candidate_us = milliseconds_since(start) * 1000 / index.documents.size();
+    printf("waking the pool: %.2f us a batch; scoring: %.3f us a candidate; break-even at %.1f candidates a shard "
+        "(SEARCH_SHARD_MIN_CANDIDATES is %d)\n", batch_us, candidate_us, batch_us / candidate_us, SEARCH_SHARD_MIN_CANDIDATES);
+
+    int board_sizes[] = {2000, 10000, 50000};
+    int min_candidates[] = {32, 128, 512, 2048};
+    int shards_per_thread[] = {1, 2, 4, 8};
+    bool same = true;
+    for (int board_size: board_sizes) {
+        fill_board(cards, board_size);
+        std::vector<SearchResult> expected;
+        SearchIndex single = init_search_index();
+        refresh_search_index(single, cards);
+        double single_ms = run_queries(single, NULL, expected);
+        printf("%6d cards: %.2f ms on one thread\n", board_size, single_ms);
+        for (int value: min_candidates) {
+            double time = time_queries(cards, &worker_pool, value, SEARCH_SHARDS_PER_THREAD, expected, same);
+            printf("    min candidates %4d, %d shards a thread: %.2f ms\n", value, SEARCH_SHARDS_PER_THREAD, time);
+        }
+        for (int value: shards_per_thread) {
+            double time = time_queries(cards, &worker_pool, SEARCH_SHARD_MIN_CANDIDATES, value, expected, same);
+            printf("    min candidates %4d, %d shards a thread: %.2f ms\n", SEARCH_SHARD_MIN_CANDIDATES, value, time);
+        }
+    }
+    printf("sharded results %s the single threaded ones\n", same ? "match" : "DON'T MATCH");
+
+    free_pool(cards);
+    stop_thread_pool(worker_pool);
+    return same ? 0 : 1;
+}
@@ -0,0 +1,177 @@
+// Checks the search index against plain fuzzy_match over every card. Queries are typed a character at a time,
+// with and without the pool, so the narrowing and the prefilters are all exercised, and the board is edited
+// between rounds so documents are refreshed, dropped and reused.
+#include "card.hpp"
+#include "card_pool.hpp"
+#include "search_index.hpp"
+#include "thread_pool.hpp"
+#include <random>
+#include <set>
+#include <tuple>
+
+// The functions are static, so this is a separate copy from the one search_index.cpp uses.
+#define FTS_FUZZY_MATCH_IMPLEMENTATION
+#include "fuzzy_match.hpp"
+
+typedef std::tuple<int, int, int> Found; // Card slot, place under it or -1, score
+
+// Text mixing cases, punctuation and a few multi-byte characters, from words that share a lot of letters.
+static std::string random_text(std::mt19937& rng, int word_count) {
+    const char *words[] = {"dragon", "Drake", "king", "kingdom", "river", "Riven", "café", "naïve", "ash—fall", "a",
+        "the", "x", "Ωmega", "gray-sky", "don't", "DRY", "42"};
+    std::string text;
+    for (int i = 0; i < word_count; i++) {
+        if (i > 0) text += rng() % 8 == 0 ? ", " : " ";
+        text += words[rng() % 17];
+    }
+    return text;
+}
+
+static Card random_card(std::mt19937& rng) {
+    auto card = init_card(random_text(rng, 1 + rng() % 2), {0, 0, 272, 208}, (CardType) (rng() % (LEGACY + 1)));
+    card.tone = rng() % 2 ? LIGHT : DARK;
+    card.content = random_text(rng, rng() % 12);
+    int under = rng() % 5 == 0 ? 1 + rng() % 3 : 0;
+    for (int i = 0; i < under; i++) {
+        auto tucked = init_card(random_text(rng, 1), {0, 0, 272, 208}, (CardType) (rng() % (LEGACY + 1)));
+        tucked.tone = rng() % 2 ? LIGHT : DARK;
+        tucked.content = random_text(rng, rng() % 8);
+        touch_card_content(tucked);
+        card.cards_under.push_back(tucked);
+    }
+    touch_card_content(card);
+    return card;
+}
+
+static std::string fold(std::string text) {
+    for (auto &c: text) c = tolower((unsigned char) c);
+    return text;
+}
+
+// Some word of the card's name or content starts with `prefix`. Bytes past ASCII are part of words.
+static bool has_word_starting_with(const Card& card, const std::string& prefix) {
+    auto text = fold(card.name + " " + card.content);
+    size_t start = 0;
+    while (start < text.size()) {
+        auto is_word = [&](size_t at) { return isalnum((unsigned char) text[at]) || (unsigned char) text[at] >= 128; };
+        while (start < text.size() && !is_word(start)) start++;
+        size_t end = start;
+        while (end < text.size() && is_word(end)) end++;
+        if (end > start && text.compare(start, prefix.size(), prefix) == 0 && end - start >= prefix.size()) return true;
+        start = end;
+    }
+    return false;
+}
+
+// What the query should find, worked out from the cards without the index.
+static void expected_matches(CardPool& cards, const std::string& query, std::set<Found>& found) {
+    SearchFilter filter;
+    std::string text;
+    parse_search_query(query, filter, text);
+    const unsigned int all_types = (1u << (LEGACY + 1)) - 1;
+    const unsigned int all_tones = (1u << (DARK + 1)) - 1;
+    bool facets = (filter.types & all_types) != all_types || (filter.tones & all_tones) != all_tones ||
+        !filter.events.empty();
+    found.clear();
+    if (text.empty() && !facets) return;
+    auto consider = [&](const Card& card, const Card *owner, int slot, int under_index) {
+        if (!(filter.types & (1u << card.type)) || !(filter.tones & (1u << card.tone))) return;
+        for (auto &word: filter.events) {
+            if (owner == NULL || owner->type != EVENT || !has_word_starting_with(*owner, word)) return;
+        }
+        int score = 0;
+        if (text.empty()) found.insert(Found(slot, under_index, 0));
+        else if (fts::fuzzy_match(text.c_str(), card.content.c_str(), score) && score > 0) found.insert(Found(slot, under_index, score));
+    };
+    for (auto &card: cards) {
+        consider(card, NULL, card.slot, -1);
+        for (int i = 0; i < (int) card.cards_under.size(); i++) consider(card.cards_under[i], &card, card.slot, i);
+    }
+}
+
+static void index_matches(SearchIndex& index, CardPool& cards, std::set<Found>& found) {
+    std::vector<SearchResult> results;
+    rank_search_matches(index, index.matches.size(), results);
+    found.clear();
+    for (auto &result: results) found.insert(Found(get_card(cards, result.card)->slot, result.under_index, result.score));
+}
+
+// Edits, deletes, adds and tucks a few cards, the way a session at the table would between searches.
+static void edit_board(CardPool& cards, std::mt19937& rng) {
+    for (auto &card: cards) {
+        int roll = rng() % 20;
+        if (roll == 0) {
+            set_card_deleted(card, true);
+        } else if (roll == 1) {
+            card.content = random_text(rng, rng() % 12);
+            touch_card_content(card);
+        } else if (roll == 2) {
+            card.type = (CardType) (rng() % (LEGACY + 1));
+            card.tone = card.tone == LIGHT ? DARK : LIGHT;
+            touch_card_content(card);
+        } else if (roll == 3 && !card.cards_under.empty()) {
+            card.cards_under.erase(card.cards_under.begin());
+        }
+    }
+    update_cards(cards);
+    for (int i = 0; i < 40; i++) add_card(cards, random_card(rng));
+    update_cards(cards);
+}
+
+int main() {
+    start_thread_pool(worker_pool, 3);
+    card_grid = init_spatial_grid();
+    auto cards = init_pool();
+    std::mt19937 rng(16);
+    for (int i = 0; i < 1500; i++) add_card(cards, random_card(rng));
+    update_cards(cards);
+
+    const char *typed[] = {"dragon k", "drk", "kingdom", "café", "naï", "Ωm", "don't", "a b", " dr", "  ash",
+        "type:", "type: dr", "type:event ki", "type:sc tone:d riv", "tone:light", "event:", "event: dr",
+        "event:dr", "event:king x", "event:zzz", "ASH—", "42", "zq", "e", ""};
+    auto index = init_search_index();
+    // Small enough that the pool splits most queries, so the shards are checked too.
+    index.shard_min_candidates = 8;
+    int queries = 0, mismatches = 0;
+    std::set<Found> expected, found;
+    for (int round = 0; round < 4; round++) {
+        if (round > 0) edit_board(cards, rng);
+        refresh_search_index(index, cards);
+        for (int pooled = 0; pooled < 2; pooled++) {
+            for (auto query: typed) {
+                std::string text = query;
+                for (size_t length = text.empty() ? 0 : 1; length <= text.size(); length++) {
+                    auto prefix = text.substr(0, length);
+                    run_search_query(index, prefix, pooled ? &worker_pool : NULL, 8);
+                    index_matches(index, cards, found);
+                    expected_matches(cards, prefix, expected);
+                    queries++;
+                    if (found != expected) {
+                        mismatches++;
+                        printf("round %d%s, '%s': %zu matches, expected %zu\n", round, pooled ? " on the pool" : "",
+                            prefix.c_str(), found.size(), expected.size());
+                    }
+
+                    // The best 8 have the best scores, whichever of any tied ones they are.
+                    std::vector<SearchResult> best;
+                    rank_search_matches(index, 8, best);
+                    std::vector<int> scores;
+                    for (auto &match: expected) scores.push_back(std::get<2>(match));
+                    std::sort(scores.begin(), scores.end(), std::greater<int>());
+                    scores.resize(std::min<size_t>(scores.size(), 8));
+                    bool ranked = best.size() == scores.size();
+                    for (size_t i = 0; ranked && i < best.size(); i++) ranked = best[i].score == scores[i];
+                    if (!ranked) {
+                        mismatches++;
+                        printf("round %d%s, '%s': best 8 out of order\n", round, pooled ? " on the pool" : "", prefix.c_str());
+                    }
+                }
+            }
+        }
+    }
+    printf("%d queries, %d mismatches\n", queries, mismatches);
+
+    free_pool(cards);
+    stop_thread_pool(worker_pool);
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,188 @@
+#include "text_buffer.hpp"
+#include <cctype>
+#include <cstring>
+
+// Room left for typing whenever the buffer is filled or grown.
+#define TEXT_BUFFER_MIN_GAP 64
+
+static size_t gap_size(const TextBuffer& buffer) {
+    return buffer.gap_end - buffer.gap_start;
+}
+
+static bool is_continuation_byte(char byte) {
+    return ((unsigned char) byte & 0xC0) == 0x80;
+}
+
+static int codepoints_between(const TextBuffer& buffer, size_t start, size_t end) {
+    int count = 0;
+    for (size_t i = start; i < end; i++) {
+        if (!is_continuation_byte(text_buffer_byte(buffer, i))) count += 1;
+    }
+    return count;
+}
+
+static bool is_space_byte(char byte) {
+    return isspace((unsigned char) byte);
+}
+
+// Caret at the end, like typing into the card always used to.
+void init_text_buffer(TextBuffer& buffer, const std::string& text) {
+    buffer.data.assign(text.size() + TEXT_BUFFER_MIN_GAP, 0);
+    std::copy(text.begin(), text.end(), buffer.data.begin());
+    buffer.gap_start = text.size();
+    buffer.gap_end = buffer.data.size();
+    buffer.caret = text.size();
+    buffer.anchor = text.size();
+}
+
+size_t text_buffer_length(const TextBuffer& buffer) {
+    return buffer.data.size() - gap_size(buffer);
+}
+
+char text_buffer_byte(const TextBuffer& buffer, size_t position) {
+    return position < buffer.gap_start ? buffer.data[position] : buffer.data[position + gap_size(buffer)];
+}
+
+std::string text_buffer_range(const TextBuffer& buffer, size_t start, size_t end) {
+    std::string out;
+    out.reserve(end - start);
+    const char *data = buffer.data.data();
+    if (start < buffer.gap_start) out.append(data + start, std::min(end, buffer.gap_start) - start);
+    if (end > buffer.gap_start) {
+        size_t from = std::max(start, buffer.gap_start);
+        out.append(data + from + gap_size(buffer), end - from);
+    }
+    return out;
+}
+
+void copy_text_buffer(const TextBuffer& buffer, std::string& out) {
+    const char *data = buffer.data.data();
+    out.assign(data, buffer.gap_start);
+    out.append(data + buffer.gap_end, buffer.data.size() - buffer.gap_end);
+}
+
+static void move_gap(TextBuffer& buffer, size_t position) {
+    char *data = buffer.data.data();
+    if (position < buffer.gap_start) {
+        size_t count = buffer.gap_start - position;
+        memmove(data + buffer.gap_end - count, data + position, count);
+        buffer.gap_start -= count;
+        buffer.gap_end -= count;
+    } else if (position > buffer.gap_start) {
+        size_t count = position - buffer.gap_start;
+        memmove(data + buffer.gap_start, data + buffer.gap_end, count);
+        buffer.gap_start += count;
+        buffer.gap_end += count;
+    }
+}
+
+// At least doubles the buffer when it has to grow, so filling it up a keystroke at a time costs O(1) a keystroke.
+static void grow_gap(TextBuffer& buffer, size_t size) {
+    if (gap_size(buffer) >= size) return;
+    size_t capacity = std::max(buffer.data.size() * 2, text_buffer_length(buffer) + size + TEXT_BUFFER_MIN_GAP);
+    size_t after = buffer.data.size() - buffer.gap_end;
+    std::vector<char> data(capacity);
+    memcpy(data.data(), buffer.data.data(), buffer.gap_start);
+    memcpy(data.data() + capacity - after, buffer.data.data() + buffer.gap_end, after);
+    buffer.gap_end = capacity - after;
+    buffer.data.swap(data);
+}
+
+// Replaces the text between `start` and `end` with `text`, leaving the caret after it and nothing selected.
+void replace_text(TextBuffer& buffer, size_t start, size_t end, const char *text, size_t size) {
+    move_gap(buffer, end);
+    buffer.gap_start = start; // What's replaced becomes part of the gap
+    grow_gap(buffer, size);
+    memcpy(buffer.data.data() + buffer.gap_start, text, size);
+    buffer.gap_start += size;
+    buffer.caret = buffer.gap_start;
+    buffer.anchor = buffer.gap_start;
+}
+
+size_t selection_start(const TextBuffer& buffer) {
+    return std::min(buffer.caret, buffer.anchor);
+}
+
+size_t selection_end(const TextBuffer& buffer) {
+    return std::max(buffer.caret, buffer.anchor);
+}
+
+bool has_selection(const TextBuffer& buffer) {
+    return buffer.caret != buffer.anchor;
+}
+
+// Moving with `select` drags the caret's end of the selection along, otherwise the selection goes.
+void move_caret(TextBuffer& buffer, size_t position, bool select) {
+    buffer.caret = position;
+    if (!select) buffer.anchor = position;
+}
+
+size_t next_codepoint(const TextBuffer& buffer, size_t position) {
+    size_t length = text_buffer_length(buffer);
+    if (position >= length) return length;
+    position += 1;
+    while (position < length && is_continuation_byte(text_buffer_byte(buffer, position))) position += 1;
+    return position;
+}
+
+size_t previous_codepoint(const TextBuffer& buffer, size_t position) {
+    if (position == 0) return 0;
+    position -= 1;
+    while (position > 0 && is_continuation_byte(text_buffer_byte(buffer, position))) position -= 1;
+    return position;
+}
+
+// To the end of the word the caret is in, or of the next one.
+size_t next_word(const TextBuffer& buffer, size_t position) {
+    size_t length = text_buffer_length(buffer);
+    while (position < length && is_space_byte(text_buffer_byte(buffer, position))) position += 1;
+    while (position < length && !is_space_byte(text_buffer_byte(buffer, position))) position += 1;
+    return position;
+}
+
+// To the start of the word the caret is in, or of the one before.
+size_t previous_word(const TextBuffer& buffer, size_t position) {
+    while (position > 0 && is_space_byte(text_buffer_byte(buffer, position - 1))) position -= 1;
+    while (position > 0 && !is_space_byte(text_buffer_byte(buffer, position - 1))) position -= 1;
+    return position;
+}
+
+// Lines are the ones the text was typed in, not where the card happens to wrap it.
+size_t line_start(const TextBuffer& buffer, size_t position) {
+    while (position > 0 && text_buffer_byte(buffer, position - 1) != '\n') position -= 1;
+    return position;
+}
+
+size_t line_end(const TextBuffer& buffer, size_t position) {
+    size_t length = text_buffer_length(buffer);
+    while (position < length && text_buffer_byte(buffer, position) != '\n') position += 1;
+    return position;
+}
+
+// Goes as many codepoints into the line starting at `start` as `position` is into its own, or to the line's end.
+static size_t same_column(const TextBuffer& buffer, size_t position, size_t start) {
+    int column = codepoints_between(buffer, line_start(buffer, position), position);
+    size_t end = line_end(buffer, start);
+    while (column > 0 && start < end) {
+        start = next_codepoint(buffer, start);
+        column -= 1;
+    }
+    return start;
+}
+
+size_t line_above(const TextBuffer& buffer, size_t position) {
+    size_t start = line_start(buffer, position);
+    if (start == 0) return 0;
+    return same_column(buffer, position, line_start(buffer, start - 1));
+}
+
+size_t line_below(const TextBuffer& buffer, size_t position) {
+    size_t end = line_end(buffer, position);
+    if (end == text_buffer_length(buffer)) return end;
+    return same_column(buffer, position, end + 1);
+}
+
+// How many codepoints come before `position`, which is how text layouts number their glyphs.
+int codepoint_index(const TextBuffer& buffer, size_t position) {
+    return codepoints_between(buffer, 0, position);
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "common.hpp"
+
+// Text being edited, kept as a gap buffer: the text before the gap, then spare room, then the text after it.
+// Edits happen at the gap, so typing or deleting anywhere costs the same however long the text is. Moving the
+// caret leaves the gap where it is; it's moved by the next edit, by as far as the caret went.
+// Positions are byte offsets into the text. The caret and anchor always sit at the start of a UTF-8 codepoint.
+struct TextBuffer {
+    std::vector<char> data;
+    size_t gap_start;
+    size_t gap_end;
+    size_t caret;
+    size_t anchor; // Other end of the selection, the same as `caret` when nothing is selected
+};
+
+void init_text_buffer(TextBuffer& buffer, const std::string& text);
+size_t text_buffer_length(const TextBuffer& buffer);
+char text_buffer_byte(const TextBuffer& buffer, size_t position);
+std::string text_buffer_range(const TextBuffer& buffer, size_t start, size_t end);
+void copy_text_buffer(const TextBuffer& buffer, std::string& out);
+void replace_text(TextBuffer& buffer, size_t start, size_t end, const char *text, size_t size);
+
+size_t selection_start(const TextBuffer& buffer);
+size_t selection_end(const TextBuffer& buffer);
+bool has_selection(const TextBuffer& buffer);
+void move_caret(TextBuffer& buffer, size_t position, bool select);
+
+size_t next_codepoint(const TextBuffer& buffer, size_t position);
+size_t previous_codepoint(const TextBuffer& buffer, size_t position);
+size_t next_word(const TextBuffer& buffer, size_t position);
+size_t previous_word(const TextBuffer& buffer, size_t position);
+size_t line_start(const TextBuffer& buffer, size_t position);
+size_t line_end(const TextBuffer& buffer, size_t position);
+size_t line_above(const TextBuffer& buffer, size_t position);
+size_t line_below(const TextBuffer& buffer, size_t position);
+int codepoint_index(const TextBuffer& buffer, size_t position);
@@ -0,0 +1,64 @@
+#include "thread_pool.hpp"
+
+// Takes jobs from the current batch until there are none left. Called with the lock held and returns with it held.
+static void work_on_batch(ThreadPool& pool, std::unique_lock<std::mutex>& lock) {
+    while (pool.next_job < pool.job_count) {
+        int job = pool.next_job++;
+        lock.unlock();
+        pool.job(job);
+        lock.lock();
+        pool.jobs_done += 1;
+        if (pool.jobs_done == pool.job_count) pool.work_done.notify_all();
+    }
+}
+
+static void worker_main(ThreadPool* pool) {
+    std::unique_lock<std::mutex> lock(pool->mutex);
+    while (true) {
+        pool->work_ready.wait(lock, [&]() { return pool->quitting || pool->next_job < pool->job_count; });
+        if (pool->quitting) return;
+        work_on_batch(*pool, lock);
+    }
+}
+
+// `thread_count` extra threads. With 0, run_on_thread_pool just runs every job on the calling thread.
+void start_thread_pool(ThreadPool& pool, int thread_count) {
+    pool.job_count = 0;
+    pool.next_job = 0;
+    pool.jobs_done = 0;
+    pool.quitting = false;
+    for (int i = 0; i < thread_count; i++) pool.threads.emplace_back(worker_main, &pool);
+}
+
+void stop_thread_pool(ThreadPool& pool) {
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.quitting = true;
+    }
+    pool.work_ready.notify_all();
+    for (auto &thread: pool.threads) thread.join();
+    pool.threads.clear();
+}
+
+// Counts the calling thread.
+int thread_pool_size(const ThreadPool& pool) {
+    return pool.threads.size() + 1;
+}
+
+void run_on_thread_pool(ThreadPool& pool, int job_count, const std::function<void(int)>& job) {
+    if (pool.threads.empty() || job_count <= 1) {
+        for (int i = 0; i < job_count; i++) job(i);
+        return;
+    }
+    std::unique_lock<std::mutex> lock(pool.mutex);
+    pool.job = job;
+    pool.job_count = job_count;
+    pool.next_job = 0;
+    pool.jobs_done = 0;
+    pool.work_ready.notify_all();
+    work_on_batch(pool, lock);
+    pool.work_done.wait(lock, [&]() { return pool.jobs_done == pool.job_count; });
+    pool.job = nullptr;
+    pool.job_count = 0;
+    pool.next_job = 0;
+}
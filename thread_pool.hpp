@@ -0,0 +1,27 @@
+#pragma once
+#include "common.hpp"
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Worker threads that sleep until run_on_thread_pool hands them a batch of jobs. The calling thread works on
+// the batch too and only returns once every job is done, so jobs can write straight into the caller's data.
+struct ThreadPool {
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable work_ready;
+    std::condition_variable work_done;
+    std::function<void(int)> job; // Called once with every job number of the current batch
+    int job_count;
+    int next_job;
+    int jobs_done;
+    bool quitting;
+};
+
+extern ThreadPool worker_pool;
+
+void start_thread_pool(ThreadPool& pool, int thread_count);
+void stop_thread_pool(ThreadPool& pool);
+int thread_pool_size(const ThreadPool& pool);
+void run_on_thread_pool(ThreadPool& pool, int job_count, const std::function<void(int)>& job);
@@ -0,0 +1,381 @@
+#include "undo.hpp"
+#include "card_pool.hpp"
+#include "serialization.hpp"
+#include <cctype>
+
+CardStyle card_style(const Card& card) {
+    return {card.tone, card.fontsize, card.is_beginning, card.is_end};
+}
+
+static bool same_style(CardStyle style1, CardStyle style2) {
+    return style1.tone == style2.tone && style1.fontsize == style2.fontsize &&
+        style1.is_beginning == style2.is_beginning && style1.is_end == style2.is_end;
+}
+
+static bool same_rect(Rectangle rect1, Rectangle rect2) {
+    return rect1.x == rect2.x && rect1.y == rect2.y && rect1.width == rect2.width && rect1.height == rect2.height;
+}
+
+static Rectangle card_position(const Card& card) {
+    return {card.lock_target.x, card.lock_target.y, card.body_rect.width, card.body_rect.height};
+}
+
+static size_t card_bytes(const Card& card) {
+    size_t bytes = sizeof(Card) + card.name.capacity() + card.content.capacity() + card.last_name.capacity() +
+        card.last_content.capacity() + card.id.capacity();
+    for (auto &under: card.cards_under) bytes += card_bytes(under);
+    return bytes;
+}
+
+static size_t command_bytes(const UndoCommand& command) {
+    size_t bytes = sizeof(UndoCommand) + command.moves.capacity() * sizeof(UndoMove) +
+        command.removed.capacity() + command.inserted.capacity();
+    for (auto &card: command.cards) bytes += card_bytes(card);
+    return bytes;
+}
+
+// What the history keeps of a card. Its layout is rebuilt whenever it's drawn. Lazy cards have to be read in
+// before they're copied, since their save may be gone by the time the copy goes back on the board.
+static Card undo_copy(const Card& card) {
+    Card copy = card;
+    copy.layout = init_text_layout();
+    copy.deleted = false;
+    copy.grabbed = false;
+    copy.selected = false;
+    copy.hover = false;
+    return copy;
+}
+
+static void trim_undo(UndoStack& undo) {
+    // The newest step is kept however big it is.
+    while (undo.bytes > UNDO_MAX_BYTES && undo.done.size() > 1) {
+        undo.bytes -= undo.done.front().bytes;
+        undo.done.pop_front();
+    }
+}
+
+static void resize_command(UndoStack& undo, UndoCommand& command) {
+    undo.bytes -= command.bytes;
+    command.bytes = command_bytes(command);
+    undo.bytes += command.bytes;
+}
+
+static void push_step(UndoStack& undo, UndoCommand command) {
+    for (auto &undone: undo.undone) undo.bytes -= undone.bytes;
+    undo.undone.clear();
+    command.bytes = command_bytes(command);
+    undo.bytes += command.bytes;
+    undo.done.push_back(std::move(command));
+    undo.typing = false;
+    trim_undo(undo);
+}
+
+static UndoCommand init_command(UndoKind kind, CardHandle card = NO_CARD) {
+    UndoCommand command = {};
+    command.kind = kind;
+    command.card = card;
+    return command;
+}
+
+void clear_undo(UndoStack& undo) {
+    undo.done.clear();
+    undo.undone.clear();
+    undo.watched.clear();
+    undo.bytes = 0;
+    undo.typing = false;
+}
+
+// Remembers where a card is before it's dragged, resized or arranged. record_card_moves then makes one step of
+// every watched card that ended up somewhere else.
+void watch_card_position(UndoStack& undo, const Card& card) {
+    auto position = card_position(card);
+    undo.watched.push_back({card.handle, position, position});
+}
+
+void record_card_moves(UndoStack& undo, CardPool& cards) {
+    auto command = init_command(UNDO_MOVE);
+    for (auto &move: undo.watched) {
+        Card *card = get_card(cards, move.card);
+        if (card == NULL) continue;
+        move.after = card_position(*card);
+        if (!same_rect(move.before, move.after)) command.moves.push_back(move);
+    }
+    undo.watched.clear();
+    if (!command.moves.empty()) push_step(undo, std::move(command));
+}
+
+// Folds a keystroke into the text edit before it if it carries on from where that left off: typing on at its end,
+// backspacing over what it typed or from where it started, or deleting forward from its end.
+static bool fold_text_edit(UndoCommand& last, size_t position, const std::string& removed, const std::string& inserted) {
+    size_t end = last.position + last.inserted.size();
+    if (removed.empty() && position == end) {
+        last.inserted += inserted;
+    } else if (inserted.empty() && position + removed.size() == end && last.inserted.size() >= removed.size() &&
+               last.inserted.compare(last.inserted.size() - removed.size(), removed.size(), removed) == 0) {
+        last.inserted.erase(last.inserted.size() - removed.size());
+    } else if (inserted.empty() && last.inserted.empty() && position + removed.size() == last.position) {
+        last.removed.insert(0, removed);
+        last.position = position;
+    } else if (inserted.empty() && position == end) {
+        last.removed += removed;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// A run of keystrokes on the same text is one step, until a pause or the start of a new word or line.
+void record_text_edit(UndoStack& undo, const Card& card, bool name, size_t position, const std::string& removed, const std::string& inserted) {
+    double now = GetTime();
+    if (undo.typing && !undo.done.empty()) {
+        auto &last = undo.done.back();
+        bool same_run = last.kind == UNDO_TEXT && last.card == card.handle && last.name == name &&
+            now - last.time < UNDO_COALESCE_SECONDS;
+        bool new_word = !inserted.empty() && isspace((unsigned char) inserted[0]) &&
+            !last.inserted.empty() && !isspace((unsigned char) last.inserted.back());
+        if (same_run && !new_word && fold_text_edit(last, position, removed, inserted)) {
+            last.time = now;
+            resize_command(undo, last);
+            trim_undo(undo);
+            return;
+        }
+    }
+
+    auto command = init_command(UNDO_TEXT, card.handle);
+    command.name = name;
+    command.position = position;
+    command.removed = removed;
+    command.inserted = inserted;
+    command.time = now;
+    push_step(undo, std::move(command));
+    undo.typing = true;
+}
+
+void record_style_change(UndoStack& undo, const Card& card, CardStyle before) {
+    auto after = card_style(card);
+    if (same_style(before, after)) return;
+    auto command = init_command(UNDO_STYLE, card.handle);
+    command.before = before;
+    command.after = after;
+    push_step(undo, std::move(command));
+}
+
+// `card` needs the handle it'll have on the board, so acquire one before adding it.
+void record_card_created(UndoStack& undo, const Card& card) {
+    auto command = init_command(UNDO_CREATE);
+    command.cards.push_back(undo_copy(card));
+    push_step(undo, std::move(command));
+}
+
+void record_cards_deleted(UndoStack& undo, const std::vector<Card*>& deleted) {
+    if (deleted.empty()) return;
+    auto command = init_command(UNDO_DELETE);
+    for (auto card: deleted) {
+        load_lazy_card(*card);
+        command.cards.push_back(undo_copy(*card));
+    }
+    push_step(undo, std::move(command));
+}
+
+// `card` is the board card as it was put under `parent`.
+void record_scene_insert(UndoStack& undo, const Card& parent, int index, const Card& card) {
+    auto command = init_command(UNDO_SCENE_INSERT, parent.handle);
+    command.index = index;
+    command.cards.push_back(undo_copy(card));
+    push_step(undo, std::move(command));
+}
+
+// `under` is the card as it was under `parent`, and `card` the copy put on the board, with the handle it'll have.
+void record_scene_remove(UndoStack& undo, const Card& parent, int index, const Card& under, const Card& card) {
+    auto command = init_command(UNDO_SCENE_REMOVE, parent.handle);
+    command.index = index;
+    command.cards.push_back(undo_copy(under));
+    command.cards.push_back(undo_copy(card));
+    push_step(undo, std::move(command));
+}
+
+void record_scene_move(UndoStack& undo, const Card& parent, int index, int to_index) {
+    if (index == to_index) return;
+    auto command = init_command(UNDO_SCENE_MOVE, parent.handle);
+    command.index = index;
+    command.to_index = to_index;
+    push_step(undo, std::move(command));
+}
+
+static void repoint_command(UndoCommand& command, CardHandle from, CardHandle to) {
+    if (command.card == from) command.card = to;
+    for (auto &move: command.moves) {
+        if (move.card == from) move.card = to;
+    }
+    for (auto &card: command.cards) {
+        if (card.handle == from) card.handle = to;
+    }
+}
+
+// Puts a copy of a card back on the board. A card that hasn't been taken off yet is just undeleted. Otherwise the
+// copy goes on with a new handle, and the steps that named the old one are pointed at it.
+static void put_card_on_board(UndoStack& undo, CardPool& cards, Card& copy) {
+    Card *on_board = get_card(cards, copy.handle);
+    if (on_board != NULL) {
+        set_card_deleted(*on_board, false);
+        return;
+    }
+    Card card = copy;
+    card.handle = NO_CARD;
+    card.parent = NO_CARD;
+    card.slot = -1;
+    card.in_drawer = false;
+    auto handle = acquire_card_handle(card);
+    for (auto &under: card.cards_under) under.parent = handle;
+    add_card(cards, card);
+
+    for (auto &command: undo.done) repoint_command(command, copy.handle, handle);
+    for (auto &command: undo.undone) repoint_command(command, copy.handle, handle);
+    for (auto &move: undo.watched) {
+        if (move.card == copy.handle) move.card = handle;
+    }
+    copy.handle = handle;
+}
+
+// Deletes the card `copy` was taken of, first bringing the copy up to date so it can be put back as it was.
+static Card* delete_from_board(CardPool& cards, Card& copy) {
+    Card *card = get_card(cards, copy.handle);
+    if (card == NULL) return NULL;
+    load_lazy_card(*card);
+    copy = undo_copy(*card);
+    set_card_deleted(*card, true);
+    return card;
+}
+
+static void insert_under(Card& parent, int index, const Card& under) {
+    Card card = under;
+    card.parent = parent.handle;
+    card.slot = -1;
+    index = clamp<int>(index, 0, parent.cards_under.size());
+    parent.cards_under.insert(parent.cards_under.begin() + index, card);
+}
+
+// The card under `parent` at `index` should be the one with `id`, but look for it if it isn't.
+static void take_out_under(Card& parent, int index, const std::string& id) {
+    auto &under = parent.cards_under;
+    if (index < 0 || index >= (int) under.size() || under[index].id != id) {
+        index = std::find_if(under.begin(), under.end(), [&](const Card& card) { return card.id == id; }) - under.begin();
+        if (index == (int) under.size()) return;
+    }
+    under.erase(under.begin() + index);
+}
+
+static void move_under(Card& parent, int index, int to_index) {
+    auto &under = parent.cards_under;
+    if (index < 0 || index >= (int) under.size() || to_index < 0 || to_index >= (int) under.size()) return;
+    Card card = std::move(under[index]);
+    under.erase(under.begin() + index);
+    under.insert(under.begin() + to_index, std::move(card));
+}
+
+static void apply_text(Card& card, const UndoCommand& command, bool forward) {
+    load_lazy_card(card);
+    auto &text = command.name ? card.name : card.content;
+    auto &from = forward ? command.removed : command.inserted;
+    auto &to = forward ? command.inserted : command.removed;
+    if (command.position + from.size() > text.size() || text.compare(command.position, from.size(), from) != 0) return;
+    text.replace(command.position, from.size(), to);
+    touch_card_content(card);
+}
+
+static void apply_style(Card& card, CardStyle style) {
+    if (card.tone != style.tone) {
+        card.tone = style.tone;
+        touch_card_content(card);
+    }
+    set_card_fontsize(card, style.fontsize);
+    card.is_beginning = style.is_beginning;
+    card.is_end = style.is_end;
+}
+
+// Redoes the step if `forward`, undoes it otherwise. Cards the step names that are gone are skipped.
+static void apply_step(UndoStack& undo, CardPool& cards, UndoCommand& command, bool forward) {
+    Card *card = get_card(cards, command.card);
+    if (card != NULL && command.kind != UNDO_MOVE) load_lazy_card(*card);
+    switch (command.kind) {
+    case UNDO_MOVE:
+        for (auto &move: command.moves) {
+            Card *moved = get_card(cards, move.card);
+            if (moved == NULL) continue;
+            auto position = forward ? move.after : move.before;
+            auto rect = moved->body_rect;
+            rect.width = position.width;
+            rect.height = position.height;
+            set_card_rect(*moved, rect);
+            set_card_target(*moved, {position.x, position.y});
+        }
+        break;
+    case UNDO_TEXT:
+        if (card != NULL) apply_text(*card, command, forward);
+        break;
+    case UNDO_STYLE:
+        if (card != NULL) apply_style(*card, forward ? command.after : command.before);
+        break;
+    case UNDO_CREATE:
+    case UNDO_DELETE:
+        for (auto &copy: command.cards) {
+            if ((command.kind == UNDO_DELETE) != forward) put_card_on_board(undo, cards, copy);
+            else delete_from_board(cards, copy);
+        }
+        break;
+    case UNDO_SCENE_INSERT:
+        if (card == NULL) break;
+        if (forward) {
+            Card *inserted = delete_from_board(cards, command.cards[0]);
+            if (inserted == NULL) break;
+            command.cards[0].saved_dimensions = {inserted->body_rect.width, inserted->body_rect.height};
+            insert_under(*card, command.index, command.cards[0]);
+        } else {
+            take_out_under(*card, command.index, command.cards[0].id);
+            put_card_on_board(undo, cards, command.cards[0]);
+        }
+        break;
+    case UNDO_SCENE_REMOVE:
+        if (card == NULL) break;
+        if (forward) {
+            take_out_under(*card, command.index, command.cards[0].id);
+            put_card_on_board(undo, cards, command.cards[1]);
+        } else {
+            delete_from_board(cards, command.cards[1]);
+            insert_under(*card, command.index, command.cards[0]);
+        }
+        break;
+    case UNDO_SCENE_MOVE:
+        if (card == NULL) break;
+        if (forward) move_under(*card, command.index, command.to_index);
+        else move_under(*card, command.to_index, command.index);
+        break;
+    }
+    // Flags and cards_under are changed directly, so the journal has to be told.
+    if (card != NULL) mark_card_edited(*card);
+}
+
+// Undoes the last step. False if there wasn't one.
+bool undo_step(UndoStack& undo, CardPool& cards) {
+    undo.typing = false;
+    if (undo.done.empty()) return false;
+    auto command = std::move(undo.done.back());
+    undo.done.pop_back();
+    apply_step(undo, cards, command, false);
+    resize_command(undo, command);
+    undo.undone.push_back(std::move(command));
+    return true;
+}
+
+// Redoes the last step undone. False if there wasn't one, or something new was done since.
+bool redo_step(UndoStack& undo, CardPool& cards) {
+    undo.typing = false;
+    if (undo.undone.empty()) return false;
+    auto command = std::move(undo.undone.back());
+    undo.undone.pop_back();
+    apply_step(undo, cards, command, true);
+    resize_command(undo, command);
+    undo.done.push_back(std::move(command));
+    trim_undo(undo);
+    return true;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "common.hpp"
+#include "card.hpp"
+#include <deque>
+
+// Undo history is dropped oldest first once the steps in it add up to this many bytes.
+#define UNDO_MAX_BYTES (4 * 1024 * 1024)
+// Keystrokes this close together on the same text are undone as one step.
+#define UNDO_COALESCE_SECONDS 1.0
+
+enum UndoKind {
+    UNDO_MOVE,         // `moves`: cards dragged, resized or arranged
+    UNDO_TEXT,         // `removed` replaced by `inserted` at `position` in the name or content of `card`
+    UNDO_STYLE,        // `card`'s tone, font size or flags changed from `before` to `after`
+    UNDO_CREATE,       // `cards` were put on the board
+    UNDO_DELETE,       // `cards` were deleted
+    UNDO_SCENE_INSERT, // `cards[0]` was taken off the board and put under `card` at `index`
+    UNDO_SCENE_REMOVE, // `cards[0]`, under `card` at `index`, was taken out and put on the board as `cards[1]`
+    UNDO_SCENE_MOVE,   // The card under `card` at `index` was moved to `to_index`
+};
+
+// Where a card was headed and how big it was. Position is the card's lock_target rather than its body_rect,
+// since that's where it ends up once it's done tweening.
+struct UndoMove {
+    CardHandle card;
+    Rectangle before;
+    Rectangle after;
+};
+
+struct CardStyle {
+    Tone tone;
+    FontSize fontsize;
+    bool is_beginning;
+    bool is_end;
+};
+
+// One step of the history. Only what the step changed is kept, apart from deleting a card, which has to keep
+// the whole card to put it back.
+struct UndoCommand {
+    UndoKind kind;
+    CardHandle card;
+    std::vector<UndoMove> moves;
+    bool name; // UNDO_TEXT: the edit was to the name, not the content
+    size_t position;
+    std::string removed;
+    std::string inserted;
+    CardStyle before;
+    CardStyle after;
+    std::vector<Card> cards; // Copies, with the handles the cards have on the board
+    int index;
+    int to_index;
+    double time; // Of the last keystroke folded into an UNDO_TEXT
+    size_t bytes;
+};
+
+// Steps are applied to the cards they name through their handles, so undoing costs in proportion to the step,
+// not the board. A card deleted and put back gets a new handle, and the steps naming the old one are pointed
+// at it, which costs in proportion to the history.
+struct UndoStack {
+    std::deque<UndoCommand> done;
+    std::vector<UndoCommand> undone; // Most recently undone last. Emptied by any new step
+    size_t bytes;
+    bool typing; // The last step was a text edit more keystrokes can be folded into
+    std::vector<UndoMove> watched; // Cards about to be moved, see watch_card_position
+};
+
+CardStyle card_style(const Card& card);
+void clear_undo(UndoStack& undo);
+void watch_card_position(UndoStack& undo, const Card& card);
+void record_card_moves(UndoStack& undo, CardPool& cards);
+void record_text_edit(UndoStack& undo, const Card& card, bool name, size_t position, const std::string& removed, const std::string& inserted);
+void record_style_change(UndoStack& undo, const Card& card, CardStyle before);
+void record_card_created(UndoStack& undo, const Card& card);
+void record_cards_deleted(UndoStack& undo, const std::vector<Card*>& deleted);
+void record_scene_insert(UndoStack& undo, const Card& parent, int index, const Card& card);
+void record_scene_remove(UndoStack& undo, const Card& parent, int index, const Card& under, const Card& card);
+void record_scene_move(UndoStack& undo, const Card& parent, int index, int to_index);
+bool undo_step(UndoStack& undo, CardPool& cards);
+bool redo_step(UndoStack& undo, CardPool& cards);
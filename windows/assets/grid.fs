@@ -0,0 +1,26 @@
+#version 330
+
+// Input fragment attributes (from fragment shader)
+in vec2 fragTexCoord;
+in vec4 fragColor;
+
+// Input uniform values
+uniform vec2 view_origin; // World position of the top left of the quad
+uniform vec2 view_size;   // World size of the quad
+uniform float spacing;    // World units between dots
+
+// Output fragment color
+out vec4 finalColor;
+
+const vec4 background = vec4(1.0, 1.0, 1.0, 1.0);
+const vec4 dot_color = vec4(0.0, 121.0/255.0, 241.0/255.0, 1.0);
+
+void main()
+{
+    vec2 world = view_origin + fragTexCoord*view_size;
+    vec2 cell = mod(world, spacing);
+    // Same as the grid texture: a dot one sixteenth of a cell wide on each side of every corner
+    float dot_size = spacing/16.0;
+    bvec2 on_line = bvec2(cell.x < dot_size || cell.x >= spacing - dot_size, cell.y < dot_size || cell.y >= spacing - dot_size);
+    finalColor = (all(on_line) ? dot_color : background)*fragColor;
+}
\ No newline at end of file